@@ -0,0 +1,62 @@
+#include "beeper.h"
+#include <cmath>
+
+Beeper::Beeper(unsigned int sample_rate) : sample_rate(sample_rate), emulated_cycle(0), clock_hz(700)
+{
+    cursor = 0;
+    phase = 0;
+    on = false;
+    has_pending = false;
+    initialize(1, sample_rate);
+}
+
+Beeper::~Beeper()
+{
+    stop();
+}
+
+void Beeper::push_edge(const Chip8::SoundEdge& edge)
+{
+    edges.push(edge);
+}
+
+void Beeper::set_position(std::uint64_t cycle, std::int64_t clock_hz)
+{
+    this->clock_hz.store(clock_hz, std::memory_order_relaxed);
+    emulated_cycle.store(cycle, std::memory_order_release);
+}
+
+bool Beeper::onGetData(Chunk& data)
+{
+    double now = (double)emulated_cycle.load(std::memory_order_acquire);
+    double cycles_per_second = (double)clock_hz.load(std::memory_order_relaxed);
+    double cycles_per_sample = cycles_per_second / sample_rate;
+    // Follow emulation at a fixed lag. Jump when it has run ahead (fast-forward) or stalled (rewind, dialogs),
+    // edges that are skipped over still switch the tone when the cursor passes them.
+    double target = now - latency * cycles_per_second;
+    if (cursor < target - latency * cycles_per_second || cursor > now) cursor = std::max(target, 0.0);
+
+    const double tone_step = 440.0 / sample_rate;
+    for (std::size_t i = 0; i < chunk_samples; i++)
+    {
+        while (has_pending || edges.pop(pending))
+        {
+            has_pending = true;
+            if (pending.cycle > cursor) break;
+            on = pending.on;
+            has_pending = false;
+        }
+        samples[i] = on ? (std::int16_t)(5000 * std::sin(2.0 * 3.14159265358979 * phase)) : 0;
+        phase += tone_step;
+        if (phase >= 1.0) phase -= 1.0;
+        cursor += cycles_per_sample;
+    }
+    data.samples = samples;
+    data.sampleCount = chunk_samples;
+    return true;
+}
+
+void Beeper::onSeek(sf::Time)
+{
+    // a live stream has no position to seek to
+}
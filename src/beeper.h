@@ -0,0 +1,46 @@
+#ifndef BEEPER
+#define BEEPER
+#include <cstdint>
+#include <atomic>
+#include <SFML/Audio.hpp>
+#include "chip8.h"
+#include "spsc_queue.h"
+
+/*
+Streaming tone generator for the sound timer.
+The emulation thread pushes sound edges stamped with emulated cycles, and the
+audio thread turns them into samples, switching the tone on or off at the
+sample the edge falls on. Playback follows the emulated cycle count at a fixed
+lag, so beep lengths follow emulated time instead of the frame rate.
+*/
+class Beeper : public sf::SoundStream
+{
+public:
+    Beeper(unsigned int sample_rate = 44100);
+    ~Beeper();
+    // emulation thread only
+    void push_edge(const Chip8::SoundEdge& edge); // dropped if the audio thread has fallen far behind
+    void set_position(std::uint64_t cycle, std::int64_t clock_hz); // how far emulation has got, and its clock rate
+private:
+    static const std::size_t chunk_samples = 256;
+    static constexpr double latency = 0.01; // seconds of emulated time playback stays behind emulation
+    unsigned int sample_rate;
+
+    // shared between the threads
+    SpscQueue<Chip8::SoundEdge, 1024> edges;
+    std::atomic<std::uint64_t> emulated_cycle;
+    std::atomic<std::int64_t> clock_hz;
+
+    // audio thread state
+    std::int16_t samples[chunk_samples];
+    double cursor; // emulated cycle of the next sample
+    double phase; // of the tone, in cycles of the 440 Hz wave
+    bool on;
+    bool has_pending;
+    Chip8::SoundEdge pending; // next edge, not reached yet
+
+    bool onGetData(Chunk& data) override;
+    void onSeek(sf::Time time_offset) override;
+};
+
+#endif /* BEEPER */
@@ -1,37 +1,139 @@
 #include "chip8.h"
+#include "chip8_jit.h"
+#include "chip8_aot.h"
 
-const sf::Time Chip8::one_over_60 = sf::seconds(1.0/60.0);
-std::random_device Chip8::RNG_random_device;
-std::mt19937 Chip8::RNG_gen;
+#if defined(CHIP8_THREADED) && !defined(__GNUC__)
+#error "CHIP8_THREADED requires labels-as-values (GCC or Clang)"
+#endif
+
+const Chip8::Handler Chip8::handlers[OP_COUNT] = {
+    &Chip8::op_invalid,
+    &Chip8::op_00E0,
+    &Chip8::op_00EE,
+    &Chip8::op_00CN,
+    &Chip8::op_00DN,
+    &Chip8::op_00FB,
+    &Chip8::op_00FC,
+    &Chip8::op_00FD,
+    &Chip8::op_00FE,
+    &Chip8::op_00FF,
+    &Chip8::op_1NNN,
+    &Chip8::op_2NNN,
+    &Chip8::op_3XNN,
+    &Chip8::op_4XNN,
+    &Chip8::op_5XY0,
+    &Chip8::op_5XY2,
+    &Chip8::op_5XY3,
+    &Chip8::op_6XNN,
+    &Chip8::op_7XNN,
+    &Chip8::op_8XY0,
+    &Chip8::op_8XY1,
+    &Chip8::op_8XY2,
+    &Chip8::op_8XY3,
+    &Chip8::op_8XY4,
+    &Chip8::op_8XY5,
+    &Chip8::op_8XY6,
+    &Chip8::op_8XY7,
+    &Chip8::op_8XYE,
+    &Chip8::op_9XY0,
+    &Chip8::op_ANNN,
+    &Chip8::op_BNNN,
+    &Chip8::op_CXNN,
+    &Chip8::op_DXYN,
+    &Chip8::op_EX9E,
+    &Chip8::op_EXA1,
+    &Chip8::op_F000,
+    &Chip8::op_FN01,
+    &Chip8::op_F002,
+    &Chip8::op_FX07,
+    &Chip8::op_FX0A,
+    &Chip8::op_FX15,
+    &Chip8::op_FX18,
+    &Chip8::op_FX1E,
+    &Chip8::op_FX29,
+    &Chip8::op_FX30,
+    &Chip8::op_FX33,
+    &Chip8::op_FX3A,
+    &Chip8::op_FX55,
+    &Chip8::op_FX65,
+    &Chip8::op_FX75,
+    &Chip8::op_FX85,
+};
 
 Chip8::Chip8()
 {
-    srand(time(NULL));
+    trap_log = &std::cerr;
+    sound_log = nullptr;
+    sound_logged = false;
+    cycle_count = 0;
+    display_generation = 0;
+    // Clock rate: 700 CHIP-8 instructions per second, configurable
+    clock_hz = 700;
+    variant = Variant::SUPER_CHIP;
+    apply_variant();
     init();
-    RNG_gen = std::mt19937(RNG_random_device());
-    RNG_distrib = std::uniform_int_distribution<int>(0x00, 0xFF);
+    std::random_device random_device;
+    seed(((std::uint64_t)random_device() << 32) | random_device());
+#ifdef CHIP8_PROFILE
+    profile.reset(new Profile()); // zeroed
+#else
+#ifdef CHIP8_JIT
+    jit.reset(new Chip8Jit(*this));
+#endif
+#ifdef CHIP8_AOT
+    aot.reset(new Chip8Aot(*this));
+#endif
+#endif
 }
 
 Chip8::~Chip8()
 {
-
+#ifdef CHIP8_PROFILE
+    profile_report(std::cerr);
+#endif
 }
 
 void Chip8::init()
 {
-    // Clock rate: 700 CHIP-8 instructions per second, configurable
-    clock_speed_t = sf::seconds(1.0/700.0);
+    clock_remainder = 0;
+    timer_phase = 0;
+    watch_timers = false;
+    timer_started = false;
+    sound_switched = false;
+    idle_loop_length = 0;
+    yield = false;
 
     // Clear memory, stack, display and registers
+#ifdef CHIP8_AOT
+    if (aot) aot->detach();
+#endif
     memset(MEM, 0, sizeof MEM);
     memset(V, 0, sizeof V);
-    exec_stack = {};
+    invalidate_decode(0, sizeof MEM);
+#ifdef CHIP8_JIT
+    if (jit) jit->flush();
+#endif
+    memset(exec_stack, 0, sizeof exec_stack); // saved whole, so unused entries must not depend on the past
+    exec_stack_size = 0;
     display = {};
+    hires = false;
+    plane_mask = 1;
+    display_generation++;
+    dirty_rows = ~0ull;
     PC = 0;
     current_PC = 0;
     I = 0;
+    timer_delay = 0;
+    timer_sound = 0;
+    memset(key_reg, 0, sizeof key_reg);
+    memset(flags, 0, sizeof flags);
+    memset(audio_pattern, 0, sizeof audio_pattern);
+    pitch = 64; // 4000 Hz playback, the XO-CHIP default
     interrupt = false;
+    exception = Chip8::Exception::INVALID_INSTRUCTION;
     block = -1;
+    instruction_count = 0;
+    log_sound(cycle_count);
 
     // initialize font cache at 0x050 to 0x09F
     font_addr = 0x050;
@@ -57,6 +159,27 @@ void Chip8::init()
     {
         MEM[font_addr + i] = font_cache[i];
     }
+    // SUPER-CHIP large digits at 0x0A0 to 0x13F, 10 bytes each
+    big_font_addr = 0x0A0;
+    std::uint8_t big_font[] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+    memcpy(&MEM[big_font_addr], big_font, sizeof big_font);
 }
 void Chip8::load_program(std::vector<std::uint8_t>& bytes, std::uint16_t loc)
 {
@@ -66,219 +189,868 @@ void Chip8::load_program(std::vector<std::uint8_t>& bytes, std::uint16_t loc)
         MEM[curr_loc] = byte;
         curr_loc++;
     }
+    invalidate_decode(loc, bytes.size());
+#ifdef CHIP8_AOT
+    if (aot) aot->attach(bytes, loc);
+#endif
     PC = loc;
     current_PC = loc;
 }
 void Chip8::update(sf::Time delta_t)
 {
-    timer_elapsed_t += delta_t;
-    while (timer_elapsed_t >= one_over_60)
+    if (delta_t <= sf::Time::Zero) return;
+    clock_remainder += delta_t.asMicroseconds() * clock_hz;
+    std::int64_t cycles = clock_remainder / 1000000;
+    clock_remainder -= cycles * 1000000;
+    run_cycles(cycles);
+}
+
+void Chip8::run_cycles(std::int64_t cycles)
+{
+    // Cycles pass even while blocked on FX0A.
+    while (cycles > 0)
+    {
+        if (interrupt || block >= 0)
+        {
+            // nothing runs until a key is pressed, only the timers move
+            std::int64_t sound_end = timer_sound > 0 ? (timer_sound * clock_hz - timer_phase + 59) / 60 : 0;
+            timer_phase += cycles * 60;
+            std::int64_t ticks = timer_phase / clock_hz;
+            timer_phase %= clock_hz;
+            timer_delay = (std::uint8_t)std::max<std::int64_t>(timer_delay - ticks, 0);
+            timer_sound = (std::uint8_t)std::max<std::int64_t>(timer_sound - ticks, 0);
+            log_sound(cycle_count + sound_end);
+            cycle_count += cycles;
+            return;
+        }
+        // Ticks do nothing while both timers are zero, so then the whole budget runs in one go unless
+        // FX15/FX18 starts a timer. Otherwise run up to the next tick.
+        watch_timers = (timer_delay == 0 && timer_sound == 0);
+        std::int64_t slice = watch_timers ? cycles : std::min(cycles, (clock_hz - timer_phase + 59) / 60);
+        std::int64_t passed = execute(slice);
+        if (idle_loop_length > 0)
+        {
+            // Nothing can change before the next tick, so whole iterations of the loop are counted
+            // as executed without running them.
+            std::int64_t skipped = (slice - passed) / idle_loop_length * idle_loop_length;
+            instruction_count += skipped;
+            passed += skipped;
+            idle_loop_length = 0;
+        }
+        else if (!timer_started && !sound_switched)
+        {
+            passed = slice; // ran to the end, or blocked or trapped while the rest of the slice passes
+        }
+        yield = false;
+        if (watch_timers && timer_started)
+        {
+            // drop the ticks before the instruction that started the timer, apply the one right after it
+            timer_phase = (timer_phase + (passed - 1) * 60) % clock_hz;
+            advance_timers(1);
+        }
+        else if (watch_timers)
+        {
+            timer_phase = (timer_phase + passed * 60) % clock_hz;
+        }
+        else
+        {
+            advance_timers(passed);
+        }
+        // a slice ends right after any FX18 that switches the sound, and ticks only happen at its end
+        log_sound(cycle_count + passed);
+        watch_timers = false;
+        timer_started = false;
+        sound_switched = false;
+        cycle_count += passed;
+        cycles -= passed;
+    }
+}
+
+void Chip8::advance_timers(std::int64_t cycles)
+{
+    timer_phase += cycles * 60;
+    while (timer_phase >= clock_hz)
     {
         timer_delay = ((timer_delay > 0) ? timer_delay - 1 : 0);
         timer_sound = ((timer_sound > 0) ? timer_sound - 1 : 0);
-        timer_elapsed_t -= one_over_60;
+        timer_phase -= clock_hz;
+    }
+}
+
+std::int64_t Chip8::execute(std::int64_t cycles)
+{
+#ifdef CHIP8_AOT
+    if (aot && aot->is_attached())
+    {
+        std::int64_t executed = aot->execute(cycles);
+        instruction_count += executed;
+        return executed;
     }
-    clock_elapsed_t += delta_t;
-    while (clock_elapsed_t >= clock_speed_t)
+#endif
+#ifdef CHIP8_JIT
+    if (jit)
+    {
+        std::int64_t executed = jit->execute(cycles);
+        instruction_count += executed;
+        return executed;
+    }
+#endif
+#ifdef CHIP8_THREADED
+    std::int64_t executed = execute_threaded(cycles);
+#else
+    std::int64_t executed = 0;
+    for (; executed < cycles && !interrupt && block < 0 && !yield; executed++)
     {
         FDE();
-        clock_elapsed_t -= clock_speed_t;
     }
+#endif
+    instruction_count += executed;
+    return executed;
 }
 
 void Chip8::FDE()
 {
     if (interrupt || block >= 0) return;
+    const Decoded* ins = fetch();
+    if (ins == nullptr) return;
+#ifdef CHIP8_PROFILE
+    profile_instruction(*ins);
+#endif
+    // Execute current instruction
+    (this->*ins->handler)(*ins);
+}
 
-    // Fetch current instruction.
+inline const Chip8::Decoded* Chip8::fetch()
+{
+    // Fetch current instruction, decoding it only the first time this address is executed.
     current_PC = PC;
-    std::uint16_t ins_U = MEM[PC];
-    std::uint16_t ins_L = MEM[PC + 1];
+    if (PC > mem_size - 2)
+    {
+        raise(Chip8::Exception::MEMORY_OUT_OF_BOUNDS);
+        return nullptr;
+    }
+    Decoded& ins = decode_cache[PC];
+    if (ins.handler == nullptr)
+    {
+        ins = decode(Instruction((MEM[PC] << 8) | MEM[PC + 1]), variant);
+    }
     PC += 2;
-    // Decode current instruction
-    Instruction ins((ins_U << 8) | ins_L);
-    // Execute current instruction
+    return &ins;
+}
+
+std::uint16_t Chip8::skip_target(std::uint16_t next) const
+{
+    bool long_load = variant == Variant::XO_CHIP && next < mem_size - 1 && MEM[next] == 0xF0 && MEM[next + 1] == 0x00;
+    return next + (long_load ? 4 : 2);
+}
+
+inline void Chip8::skip()
+{
+    PC = skip_target(PC);
+}
+
+bool Chip8::check_bounds(int addr, int num_bytes)
+{
+    if (addr + num_bytes <= mem_size) return true;
+    raise(Chip8::Exception::MEMORY_OUT_OF_BOUNDS);
+    return false;
+}
+
+#ifdef CHIP8_THREADED
+// Each handler ends with its own indirect jump to the next one, instead of all
+// instructions sharing the single indirect branch of the dispatch in FDE().
+std::int64_t Chip8::execute_threaded(std::int64_t cycles)
+{
+    std::int64_t executed = 0;
+    static void* const labels[OP_COUNT] = {
+        &&L_invalid,
+        &&L_00E0,
+        &&L_00EE,
+        &&L_00CN,
+        &&L_00DN,
+        &&L_00FB,
+        &&L_00FC,
+        &&L_00FD,
+        &&L_00FE,
+        &&L_00FF,
+        &&L_1NNN,
+        &&L_2NNN,
+        &&L_3XNN,
+        &&L_4XNN,
+        &&L_5XY0,
+        &&L_5XY2,
+        &&L_5XY3,
+        &&L_6XNN,
+        &&L_7XNN,
+        &&L_8XY0,
+        &&L_8XY1,
+        &&L_8XY2,
+        &&L_8XY3,
+        &&L_8XY4,
+        &&L_8XY5,
+        &&L_8XY6,
+        &&L_8XY7,
+        &&L_8XYE,
+        &&L_9XY0,
+        &&L_ANNN,
+        &&L_BNNN,
+        &&L_CXNN,
+        &&L_DXYN,
+        &&L_EX9E,
+        &&L_EXA1,
+        &&L_F000,
+        &&L_FN01,
+        &&L_F002,
+        &&L_FX07,
+        &&L_FX0A,
+        &&L_FX15,
+        &&L_FX18,
+        &&L_FX1E,
+        &&L_FX29,
+        &&L_FX30,
+        &&L_FX33,
+        &&L_FX3A,
+        &&L_FX55,
+        &&L_FX65,
+        &&L_FX75,
+        &&L_FX85,
+    };
+    const Decoded* ins;
+#ifdef CHIP8_PROFILE
+#define PROFILE_INSTRUCTION() profile_instruction(*ins)
+#else
+#define PROFILE_INSTRUCTION()
+#endif
+#define DISPATCH() \
+    do { \
+        if (executed >= cycles || interrupt || block >= 0 || yield) return executed; \
+        executed++; \
+        if ((ins = fetch()) == nullptr) return executed; \
+        PROFILE_INSTRUCTION(); \
+        goto *labels[ins->op]; \
+    } while (0)
+
+    DISPATCH();
+L_invalid: op_invalid(*ins); DISPATCH();
+L_00E0: op_00E0(*ins); DISPATCH();
+L_00EE: op_00EE(*ins); DISPATCH();
+L_00CN: op_00CN(*ins); DISPATCH();
+L_00DN: op_00DN(*ins); DISPATCH();
+L_00FB: op_00FB(*ins); DISPATCH();
+L_00FC: op_00FC(*ins); DISPATCH();
+L_00FD: op_00FD(*ins); DISPATCH();
+L_00FE: op_00FE(*ins); DISPATCH();
+L_00FF: op_00FF(*ins); DISPATCH();
+L_1NNN: op_1NNN(*ins); DISPATCH();
+L_2NNN: op_2NNN(*ins); DISPATCH();
+L_3XNN: op_3XNN(*ins); DISPATCH();
+L_4XNN: op_4XNN(*ins); DISPATCH();
+L_5XY0: op_5XY0(*ins); DISPATCH();
+L_5XY2: op_5XY2(*ins); DISPATCH();
+L_5XY3: op_5XY3(*ins); DISPATCH();
+L_6XNN: op_6XNN(*ins); DISPATCH();
+L_7XNN: op_7XNN(*ins); DISPATCH();
+L_8XY0: op_8XY0(*ins); DISPATCH();
+L_8XY1: op_8XY1(*ins); DISPATCH();
+L_8XY2: op_8XY2(*ins); DISPATCH();
+L_8XY3: op_8XY3(*ins); DISPATCH();
+L_8XY4: op_8XY4(*ins); DISPATCH();
+L_8XY5: op_8XY5(*ins); DISPATCH();
+L_8XY6: op_8XY6(*ins); DISPATCH();
+L_8XY7: op_8XY7(*ins); DISPATCH();
+L_8XYE: op_8XYE(*ins); DISPATCH();
+L_9XY0: op_9XY0(*ins); DISPATCH();
+L_ANNN: op_ANNN(*ins); DISPATCH();
+L_BNNN: op_BNNN(*ins); DISPATCH();
+L_CXNN: op_CXNN(*ins); DISPATCH();
+L_DXYN: op_DXYN(*ins); DISPATCH();
+L_EX9E: op_EX9E(*ins); DISPATCH();
+L_EXA1: op_EXA1(*ins); DISPATCH();
+L_F000: op_F000(*ins); DISPATCH();
+L_FN01: op_FN01(*ins); DISPATCH();
+L_F002: op_F002(*ins); DISPATCH();
+L_FX07: op_FX07(*ins); DISPATCH();
+L_FX0A: op_FX0A(*ins); DISPATCH();
+L_FX15: op_FX15(*ins); DISPATCH();
+L_FX18: op_FX18(*ins); DISPATCH();
+L_FX1E: op_FX1E(*ins); DISPATCH();
+L_FX29: op_FX29(*ins); DISPATCH();
+L_FX30: op_FX30(*ins); DISPATCH();
+L_FX33: op_FX33(*ins); DISPATCH();
+L_FX3A: op_FX3A(*ins); DISPATCH();
+L_FX55: op_FX55(*ins); DISPATCH();
+L_FX65: op_FX65(*ins); DISPATCH();
+L_FX75: op_FX75(*ins); DISPATCH();
+L_FX85: op_FX85(*ins); DISPATCH();
+#undef DISPATCH
+#undef PROFILE_INSTRUCTION
+}
+#endif
+
+Chip8::Decoded Chip8::decode(const Instruction& ins, Variant variant)
+{
+    Decoded d;
+    d.op = OP_INVALID;
+    d.NNN = ins.NNN();
+    d.X = ins.X();
+    d.Y = ins.Y();
+    d.N = ins.N();
+    d.NN = ins.NN();
+    bool xo = variant == Variant::XO_CHIP;
     switch (ins.opcode())
     {
         case 0x0:
-            switch (ins.NNN()) 
+            switch (ins.NNN())
             {
-                case 0x0E0: // 00E0: clear screen
-                    display = {};
-                    break;
-                case 0x0EE: // 00EE: return from subroutine
-                    if (exec_stack.empty())
-                    {
-                        raise(Chip8::Exception::STACK_UNDERFLOW);
-                    }
-                    else
-                    {
-                        PC = exec_stack.top();
-                        exec_stack.pop();
-                    }
-                    break;
+                case 0x0E0: d.op = OP_00E0; break; // 00E0: clear screen
+                case 0x0EE: d.op = OP_00EE; break; // 00EE: return from subroutine
+                case 0x0FB: d.op = OP_00FB; break; // 00FB: scroll right by 4 pixels
+                case 0x0FC: d.op = OP_00FC; break; // 00FC: scroll left by 4 pixels
+                case 0x0FD: d.op = OP_00FD; break; // 00FD: exit
+                case 0x0FE: d.op = OP_00FE; break; // 00FE: low resolution
+                case 0x0FF: d.op = OP_00FF; break; // 00FF: high resolution
                 default:
-                    raise(Chip8::Exception::INVALID_INSTRUCTION);
+                    if ((ins.NNN() & 0xFF0) == 0x0C0) d.op = OP_00CN; // 00CN: scroll down by N rows
+                    else if ((ins.NNN() & 0xFF0) == 0x0D0 && xo) d.op = OP_00DN; // 00DN: scroll up by N rows
+                    break;
             }
             break;
-        case 0x1: // 1NNN: Jump to NNN
-            PC = ins.NNN();
-            break;
-        case 0x2: // 2NNN: Subroutine starting at NNN
-            exec_stack.push(PC);
-            PC = ins.NNN();
-            break;
-        case 0x3: // 3XNN: skip if VX == NN
-            if (V[ins.X()] == ins.NN()) PC += 2;
-            break;
-        case 0x4: // 4XNN: skip if VX != NN
-            if (V[ins.X()] != ins.NN()) PC += 2;
-            break;
-        case 0x5: // 5XY0: skip if VX == VY
-            if (ins.N() != 0)
-            {
-                raise(Chip8::Exception::INVALID_INSTRUCTION);
-            }
-            else
+        case 0x1: d.op = OP_1NNN; break; // 1NNN: Jump to NNN
+        case 0x2: d.op = OP_2NNN; break; // 2NNN: Subroutine starting at NNN
+        case 0x3: d.op = OP_3XNN; break; // 3XNN: skip if VX == NN
+        case 0x4: d.op = OP_4XNN; break; // 4XNN: skip if VX != NN
+        case 0x5:
+            switch (ins.N())
             {
-                if (V[ins.X()] == V[ins.Y()]) PC += 2;
+                case 0x0: d.op = OP_5XY0; break; // 5XY0: skip if VX == VY
+                case 0x2: if (xo) d.op = OP_5XY2; break; // 5XY2: store VX to VY
+                case 0x3: if (xo) d.op = OP_5XY3; break; // 5XY3: load VX to VY
             }
             break;
-        case 0x6: // 6XNN: set VX := NN
-            V[ins.X()] = ins.NN();
-            break;
-        case 0x7: // 7XNN: add VX += NN
-            V[ins.X()] += ins.NN();
-            break;
+        case 0x6: d.op = OP_6XNN; break; // 6XNN: set VX := NN
+        case 0x7: d.op = OP_7XNN; break; // 7XNN: add VX += NN
         case 0x8: // 8XYN: arithmetic/logical ops
             switch (ins.N())
             {
-            case 0x0: V[ins.X()] = V[ins.Y()]; break; // set
-            case 0x1: V[ins.X()] |= V[ins.Y()]; break; // binary OR
-            case 0x2: V[ins.X()] &= V[ins.Y()]; break; // binary AND
-            case 0x3: V[ins.X()] ^= V[ins.Y()]; break; // binary XOR
-            case 0x4: // ADD X, X, Y, with carry flag
-                if ( (int)V[ins.X()] + (int)V[ins.Y()] > 255 )
-                    V[0xF] = 1;
-                else V[0xF] = 0;
-                V[ins.X()] += V[ins.Y()];
-                break;
-            case 0x5: // SUB X, X, Y, with underflow flag
-                if ( (int)V[ins.X()] > (int)V[ins.Y()])
-                    V[0xF] = 1;
-                else V[0xF] = 0;
-                V[ins.X()] = V[ins.X()] - V[ins.Y()];
-                break;
-            case 0x6: // SHR X, X, Y
-                // TODO: configure setting VY to Vx
-                V[0xF] = (V[ins.X()] & 1);
-                V[ins.X()] = (V[ins.X()] >> 1);
-                break;
-            case 0x7: // SUB X, Y, X, with underflow flag
-                if ( (int)V[ins.Y()] > (int)V[ins.X()])
-                    V[0xF] = 1;
-                else V[0xF] = 0;
-                V[ins.X()] = V[ins.Y()] - V[ins.X()];
-                break;
-            case 0xE: // SHl X, X, Y
-                // TODO: configure setting VY to Vx
-                V[0xF] = (V[ins.X()] >> 7);
-                V[ins.X()] = (V[ins.X()] << 1);
-                break;
-            default:  raise(Chip8::Exception::INVALID_INSTRUCTION); break;
-            }
-            break;
-        case 0x9: // 9XY0: skip if VX != VY
-            if (ins.N() != 0)
-            {
-                raise(Chip8::Exception::INVALID_INSTRUCTION);
-            }
-            else
-            {
-                if (V[ins.X()] != V[ins.Y()]) PC += 2;
+                case 0x0: d.op = OP_8XY0; break;
+                case 0x1: d.op = OP_8XY1; break;
+                case 0x2: d.op = OP_8XY2; break;
+                case 0x3: d.op = OP_8XY3; break;
+                case 0x4: d.op = OP_8XY4; break;
+                case 0x5: d.op = OP_8XY5; break;
+                case 0x6: d.op = OP_8XY6; break;
+                case 0x7: d.op = OP_8XY7; break;
+                case 0xE: d.op = OP_8XYE; break;
             }
-
-            break;
-        case 0xA: // ANNN: set the index register I to NNN
-            I = ins.NNN();
-            break;
-        case 0xB: // BXNN: Jump with offset
-            // TODO: Legacy mode with BNNN instruction
-            PC = ins.NNN() + V[ins.X()];
-            break;
-        case 0xC: // CNNN: Random number generation
-            V[ins.X()] = (RNG_distrib(RNG_gen) & ins.NN());
-            break;
-        case 0xD: // DXYN: display sprite to screen
-            display_sprite(V[ins.X()], V[ins.Y()], ins.N());
             break;
+        case 0x9: if (ins.N() == 0) d.op = OP_9XY0; break; // 9XY0: skip if VX != VY
+        case 0xA: d.op = OP_ANNN; break; // ANNN: set the index register I to NNN
+        case 0xB: d.op = OP_BNNN; break; // BXNN: Jump with offset
+        case 0xC: d.op = OP_CXNN; break; // CNNN: Random number generation
+        case 0xD: d.op = OP_DXYN; break; // DXYN: display sprite to screen
         case 0xE: // EXNN: skip if key
             switch (ins.NN())
             {
-                case 0x9E: if (key_reg[V[ins.X()]]) PC += 2; break;
-                case 0xA1: if (!key_reg[V[ins.X()]]) PC += 2; break;
-                default: raise(Chip8::Exception::INVALID_INSTRUCTION); break;
+                case 0x9E: d.op = OP_EX9E; break;
+                case 0xA1: d.op = OP_EXA1; break;
             }
             break;
         case 0xF:
             switch (ins.NN())
             {
-            case 0x07: V[ins.X()] = timer_delay; break; // set VX to delay timer
-            case 0x0A: block = ins.X(); break;
-            case 0x15: timer_delay = V[ins.X()]; break; // set delay timer to VX
-            case 0x18: timer_sound = V[ins.X()]; break; // set sound timer to VX
-            case 0x1E: I += V[ins.X()]; break; // add to index
-            case 0x29: I = font_addr + V[ins.X()] * 5; break; // Font character
-            case 0x33: // BCD
-                MEM[I] = V[ins.X()] / 100;
-                MEM[I + 1] = V[ins.X()] / 10 % 10;
-                MEM[I + 2] = V[ins.X()] % 10;
-                break;
-            case 0x55: // store memory
-                for (int offset = 0; offset <= ins.X(); offset++)
-                {
-                    MEM[I + offset] = V[offset];
-                }
-                break; 
-            case 0x65: // load memory
-                for (int offset = 0; offset <= ins.X(); offset++)
-                {
-                    V[offset] = MEM[I + offset];
-                }
-                break; 
-            default:
-                raise(Chip8::Exception::INVALID_INSTRUCTION);
-                break;
+                case 0x00: if (xo && ins.X() == 0) d.op = OP_F000; break; // F000 NNNN: long load into I
+                case 0x01: if (xo) d.op = OP_FN01; break; // FN01: select planes
+                case 0x02: if (xo && ins.X() == 0) d.op = OP_F002; break; // F002: load audio pattern
+                case 0x07: d.op = OP_FX07; break;
+                case 0x0A: d.op = OP_FX0A; break;
+                case 0x15: d.op = OP_FX15; break;
+                case 0x18: d.op = OP_FX18; break;
+                case 0x1E: d.op = OP_FX1E; break;
+                case 0x29: d.op = OP_FX29; break;
+                case 0x30: d.op = OP_FX30; break;
+                case 0x33: d.op = OP_FX33; break;
+                case 0x3A: if (xo) d.op = OP_FX3A; break; // FX3A: set pitch
+                case 0x55: d.op = OP_FX55; break;
+                case 0x65: d.op = OP_FX65; break;
+                case 0x75: d.op = OP_FX75; break;
+                case 0x85: d.op = OP_FX85; break;
             }
             break;
     }
+    d.handler = handlers[d.op];
+    return d;
+}
+
+void Chip8::invalidate_decode(int addr, int num_bytes)
+{
+    // an instruction starting one byte before addr also reads from it
+    int first = std::max(addr - 1, 0);
+    int last = std::min(addr + num_bytes, mem_size);
+    for (int adr = first; adr < last; adr++)
+    {
+        decode_cache[adr].handler = nullptr;
+    }
+#ifdef CHIP8_JIT
+    if (jit) jit->invalidate(addr, num_bytes);
+#endif
+#ifdef CHIP8_AOT
+    if (aot) aot->invalidate(addr, num_bytes);
+#endif
+}
+
+void Chip8::apply_variant()
+{
+    mem_size = variant == Variant::XO_CHIP ? XOCHIP_MEMORY_SIZE : CHIP8_MEMORY_SIZE;
+    // decoding depends on the variant, so nothing decoded before can be kept
+    decode_cache.assign(mem_size, Decoded{});
+#ifdef CHIP8_JIT
+    if (jit) jit->flush();
+#endif
+}
+
+void Chip8::op_invalid(const Decoded& d)
+{
+    raise(Chip8::Exception::INVALID_INSTRUCTION);
+}
+
+void Chip8::op_00E0(const Decoded& d) // clear the selected planes
+{
+    // rows below the current resolution are always blank
+    int height = display_height();
+    std::uint64_t rows = 0;
+    for (int p = 0; p < CHIP8_PLANES; p++)
+    {
+        if ((plane_mask & (1 << p)) == 0) continue;
+        // only rows with pixels set are written
+        std::uint64_t* row = display[p].data();
+        for (int y = 0; y < height; y++, row += CHIP8_ROW_WORDS)
+        {
+            if ((row[0] | row[1]) == 0) continue;
+            rows |= 1ull << y;
+            row[0] = 0;
+            row[1] = 0;
+        }
+    }
+    dirty_rows |= rows;
+    display_generation++;
+}
+
+void Chip8::op_00EE(const Decoded& d) // return from subroutine
+{
+    if (exec_stack_size == 0)
+    {
+        raise(Chip8::Exception::STACK_UNDERFLOW);
+    }
+    else
+    {
+        PC = exec_stack[--exec_stack_size];
+    }
+}
+
+void Chip8::op_00CN(const Decoded& d) { scroll_vertical(d.N); } // scroll down by N rows
+void Chip8::op_00DN(const Decoded& d) { scroll_vertical(-d.N); } // scroll up by N rows
+
+void Chip8::scroll_vertical(int rows)
+{
+    int height = display_height();
+    int count = std::min(std::abs(rows), height);
+    int kept = (height - count) * CHIP8_ROW_WORDS;
+    for (int p = 0; p < CHIP8_PLANES; p++)
+    {
+        if ((plane_mask & (1 << p)) == 0) continue;
+        std::uint64_t* words = display[p].data();
+        if (rows > 0)
+        {
+            std::memmove(words + count * CHIP8_ROW_WORDS, words, kept * sizeof words[0]);
+            std::fill(words, words + count * CHIP8_ROW_WORDS, 0);
+        }
+        else
+        {
+            std::memmove(words, words + count * CHIP8_ROW_WORDS, kept * sizeof words[0]);
+            std::fill(words + kept, words + height * CHIP8_ROW_WORDS, 0);
+        }
+    }
+    dirty_rows = ~0ull;
+    display_generation++;
+}
+
+void Chip8::op_00FB(const Decoded& d) // scroll right by 4 pixels
+{
+    // pixels shifted out of the first word enter the second, which is only visible in high resolution
+    int height = display_height();
+    for (int p = 0; p < CHIP8_PLANES; p++)
+    {
+        if ((plane_mask & (1 << p)) == 0) continue;
+        for (int y = 0; y < height; y++)
+        {
+            std::uint64_t* row = &display[p][y * CHIP8_ROW_WORDS];
+            row[1] = hires ? (row[1] >> 4) | (row[0] << 60) : 0;
+            row[0] >>= 4;
+        }
+    }
+    dirty_rows = ~0ull;
+    display_generation++;
+}
+
+void Chip8::op_00FC(const Decoded& d) // scroll left by 4 pixels
+{
+    int height = display_height();
+    for (int p = 0; p < CHIP8_PLANES; p++)
+    {
+        if ((plane_mask & (1 << p)) == 0) continue;
+        for (int y = 0; y < height; y++)
+        {
+            std::uint64_t* row = &display[p][y * CHIP8_ROW_WORDS];
+            row[0] = (row[0] << 4) | (row[1] >> 60);
+            row[1] <<= 4;
+        }
+    }
+    dirty_rows = ~0ull;
+    display_generation++;
+}
+
+void Chip8::op_00FD(const Decoded& d) // exit, not an error so memory is not dumped
+{
+    exception = Chip8::Exception::EXIT;
+    interrupt = true;
+}
+
+void Chip8::op_00FE(const Decoded& d) { set_resolution(false); } // low resolution
+void Chip8::op_00FF(const Decoded& d) { set_resolution(true); } // high resolution
+
+void Chip8::op_1NNN(const Decoded& d) // jump to NNN
+{
+    PC = d.NNN;
+    int length = idle_loop_at(current_PC);
+    // the delay timer wait only idles while it keeps reading the same nonzero value
+    if (length == 3 && (timer_delay == 0 || V[decode_cache[d.NNN].X] != timer_delay)) length = 0;
+    if (length > 0)
+    {
+        idle_loop_length = length;
+        yield = true;
+    }
+}
+
+int Chip8::idle_loop_at(std::uint16_t pc) const
+{
+    const Decoded& jump = decode_cache[pc];
+    if (jump.NNN == pc) return 1;
+    // FX07, 3X00, 1NNN back to the FX07
+    if (pc < 4 || jump.NNN != pc - 4) return 0;
+    const Decoded& read = decode_cache[pc - 4];
+    const Decoded& skip = decode_cache[pc - 2];
+    if (read.handler == nullptr || skip.handler == nullptr) return 0;
+    if (read.op == OP_FX07 && skip.op == OP_3XNN && skip.X == read.X && skip.NN == 0) return 3;
+    return 0;
+}
+
+void Chip8::op_2NNN(const Decoded& d) // subroutine starting at NNN
+{
+    if (exec_stack_size == stack_depth)
+    {
+        raise(Chip8::Exception::STACK_OVERFLOW);
+    }
+    else
+    {
+        exec_stack[exec_stack_size++] = PC;
+        PC = d.NNN;
+    }
+}
+
+void Chip8::op_3XNN(const Decoded& d) // skip if VX == NN
+{
+    if (V[d.X] == d.NN) skip();
+}
+
+void Chip8::op_4XNN(const Decoded& d) // skip if VX != NN
+{
+    if (V[d.X] != d.NN) skip();
+}
+
+void Chip8::op_5XY0(const Decoded& d) // skip if VX == VY
+{
+    if (V[d.X] == V[d.Y]) skip();
+}
+
+void Chip8::op_5XY2(const Decoded& d) // store VX to VY in memory from I, in either order, I is unchanged
+{
+    int count = std::abs(d.X - d.Y) + 1;
+    int step = d.X <= d.Y ? 1 : -1;
+    if (!check_bounds(I, count)) return;
+    for (int offset = 0; offset < count; offset++)
+    {
+        MEM[I + offset] = V[d.X + offset * step];
+    }
+    invalidate_decode(I, count);
+}
+
+void Chip8::op_5XY3(const Decoded& d) // load VX to VY from memory at I, in either order, I is unchanged
+{
+    int count = std::abs(d.X - d.Y) + 1;
+    int step = d.X <= d.Y ? 1 : -1;
+    if (!check_bounds(I, count)) return;
+    for (int offset = 0; offset < count; offset++)
+    {
+        V[d.X + offset * step] = MEM[I + offset];
+    }
+}
+
+void Chip8::op_6XNN(const Decoded& d) // set VX := NN
+{
+    V[d.X] = d.NN;
+}
+
+void Chip8::op_7XNN(const Decoded& d) // add VX += NN
+{
+    V[d.X] += d.NN;
+}
+
+void Chip8::op_8XY0(const Decoded& d) { V[d.X] = V[d.Y]; } // set
+void Chip8::op_8XY1(const Decoded& d) { V[d.X] |= V[d.Y]; } // binary OR
+void Chip8::op_8XY2(const Decoded& d) { V[d.X] &= V[d.Y]; } // binary AND
+void Chip8::op_8XY3(const Decoded& d) { V[d.X] ^= V[d.Y]; } // binary XOR
+
+void Chip8::op_8XY4(const Decoded& d) // ADD X, X, Y, with carry flag
+{
+    if ( (int)V[d.X] + (int)V[d.Y] > 255 )
+        V[0xF] = 1;
+    else V[0xF] = 0;
+    V[d.X] += V[d.Y];
+}
+
+void Chip8::op_8XY5(const Decoded& d) // SUB X, X, Y, with underflow flag
+{
+    if ( (int)V[d.X] > (int)V[d.Y])
+        V[0xF] = 1;
+    else V[0xF] = 0;
+    V[d.X] = V[d.X] - V[d.Y];
+}
+
+void Chip8::op_8XY6(const Decoded& d) // SHR X, X, Y
+{
+    // TODO: configure setting VY to Vx
+    V[0xF] = (V[d.X] & 1);
+    V[d.X] = (V[d.X] >> 1);
+}
+
+void Chip8::op_8XY7(const Decoded& d) // SUB X, Y, X, with underflow flag
+{
+    if ( (int)V[d.Y] > (int)V[d.X])
+        V[0xF] = 1;
+    else V[0xF] = 0;
+    V[d.X] = V[d.Y] - V[d.X];
+}
+
+void Chip8::op_8XYE(const Decoded& d) // SHl X, X, Y
+{
+    // TODO: configure setting VY to Vx
+    V[0xF] = (V[d.X] >> 7);
+    V[d.X] = (V[d.X] << 1);
+}
+
+void Chip8::op_9XY0(const Decoded& d) // skip if VX != VY
+{
+    if (V[d.X] != V[d.Y]) skip();
+}
+
+void Chip8::op_ANNN(const Decoded& d) // set the index register I to NNN
+{
+    I = d.NNN;
+}
+
+void Chip8::op_BNNN(const Decoded& d) // jump with offset
+{
+    // TODO: Legacy mode with BNNN instruction
+    PC = d.NNN + V[d.X];
+}
+
+void Chip8::op_CXNN(const Decoded& d) // random number generation
+{
+    V[d.X] = ((RNG.next() >> 24) & d.NN);
+}
+
+void Chip8::op_DXYN(const Decoded& d) // display sprite to screen
+{
+    display_sprite(V[d.X], V[d.Y], d.N);
+}
+
+void Chip8::op_EX9E(const Decoded& d) // skip if key VX pressed
+{
+    if (key_reg[V[d.X] & 0xF]) skip();
+}
+
+void Chip8::op_EXA1(const Decoded& d) // skip if key VX not pressed
+{
+    if (!key_reg[V[d.X] & 0xF]) skip();
+}
+
+void Chip8::op_F000(const Decoded& d) // long load, I := the 16-bit word following the instruction
+{
+    // read when executed rather than decoded, so the decode cache only ever covers 2-byte instructions
+    if (!check_bounds(PC, 2)) return;
+    I = (MEM[PC] << 8) | MEM[PC + 1];
+    PC += 2;
+}
+
+void Chip8::op_FN01(const Decoded& d) { plane_mask = d.X & ((1 << CHIP8_PLANES) - 1); } // select planes
+
+void Chip8::op_F002(const Decoded& d) // load the 16-byte audio pattern from I
+{
+    if (!check_bounds(I, sizeof audio_pattern)) return;
+    memcpy(audio_pattern, &MEM[I], sizeof audio_pattern);
+}
+
+void Chip8::op_FX07(const Decoded& d) { V[d.X] = timer_delay; } // set VX to delay timer
+void Chip8::op_FX0A(const Decoded& d) { block = d.X; } // wait for keypress
+void Chip8::op_FX15(const Decoded& d) // set delay timer to VX
+{
+    timer_delay = V[d.X];
+    if (watch_timers && timer_delay != 0) timer_started = yield = true;
+}
+
+void Chip8::op_FX18(const Decoded& d) // set sound timer to VX
+{
+    bool was_on = timer_sound > 0;
+    timer_sound = V[d.X];
+    if (watch_timers && timer_sound != 0) timer_started = yield = true;
+    else if (was_on != (timer_sound > 0)) sound_switched = yield = true;
+}
+
+void Chip8::op_FX1E(const Decoded& d) { I += V[d.X]; } // add to index
+void Chip8::op_FX29(const Decoded& d) { I = font_addr + V[d.X] * 5; } // font character
+void Chip8::op_FX30(const Decoded& d) { I = big_font_addr + V[d.X] * 10; } // large font character
+
+void Chip8::op_FX33(const Decoded& d) // BCD
+{
+    if (!check_bounds(I, 3)) return;
+    MEM[I] = V[d.X] / 100;
+    MEM[I + 1] = V[d.X] / 10 % 10;
+    MEM[I + 2] = V[d.X] % 10;
+    invalidate_decode(I, 3);
+}
+
+void Chip8::op_FX3A(const Decoded& d) { pitch = V[d.X]; } // audio pattern playback rate
+
+void Chip8::op_FX55(const Decoded& d) // store memory
+{
+    if (!check_bounds(I, d.X + 1)) return;
+    for (int offset = 0; offset <= d.X; offset++)
+    {
+        MEM[I + offset] = V[offset];
+    }
+    invalidate_decode(I, d.X + 1);
+    if (variant == Variant::XO_CHIP) I += d.X + 1; // XO-CHIP programs expect I to move past the registers, as in Octo
+}
+
+void Chip8::op_FX65(const Decoded& d) // load memory
+{
+    if (!check_bounds(I, d.X + 1)) return;
+    for (int offset = 0; offset <= d.X; offset++)
+    {
+        V[offset] = MEM[I + offset];
+    }
+    if (variant == Variant::XO_CHIP) I += d.X + 1;
+}
+
+void Chip8::op_FX75(const Decoded& d) // save V0 to VX in the user flags
+{
+    for (int offset = 0; offset <= d.X; offset++)
+    {
+        flags[offset] = V[offset];
+    }
+}
+
+void Chip8::op_FX85(const Decoded& d) // load V0 to VX from the user flags
+{
+    for (int offset = 0; offset <= d.X; offset++)
+    {
+        V[offset] = flags[offset];
+    }
 }
 
 void Chip8::display_sprite(int x, int y, int num_bytes)
 {
-    x %= CHIP8_DISPLAY_WIDTH;
-    y %= CHIP8_DISPLAY_HEIGHT;
+    // DXY0 draws a 16x16 sprite, two bytes per row
+    int rows = num_bytes == 0 ? 16 : num_bytes;
+    int row_bytes = num_bytes == 0 ? 2 : 1;
+    // the display sizes are powers of two
+    x &= display_width() - 1;
+    y &= display_height() - 1;
     V[0xF] = 0;
-    for (int dy = 0; dy < num_bytes; dy++)
+    display_generation++;
+    // each selected plane draws its own sprite, stored one after the other from I
+    int addr = I;
+    std::uint64_t collision = 0;
+    for (int p = 0; p < CHIP8_PLANES; p++)
     {
-        if (I + dy >= 4096)
+        if ((plane_mask & (1 << p)) == 0) continue;
+        // rows past the end of memory trap after the rows before them are drawn
+        int valid_rows = std::min(rows, std::max(mem_size - addr, 0) >> (row_bytes - 1));
+        collision |= draw_plane(display[p], MEM + std::min(addr, mem_size), x, y, valid_rows, row_bytes);
+        if (valid_rows < rows)
         {
             raise(Chip8::Exception::MEMORY_OUT_OF_BOUNDS);
             break;
         }
-        std::uint8_t current_byte = MEM[I + dy];
-        // draw byte row
-        for (int dx = 0; dx < 8; dx++)
-        {
-            int nx = x + dx;
-            int ny = y + dy;
-            if (nx < 0 || ny < 0 || nx >= CHIP8_DISPLAY_WIDTH || ny >= CHIP8_DISPLAY_HEIGHT) continue;
+        addr += rows * row_bytes;
+    }
+    if (collision != 0) V[0xF] = 1;
+}
 
-            bool sprite_bit = (((current_byte >> (7 - dx)) & 1) != 0) ;
-            display[ny][nx] ^= sprite_bit;
-            if (sprite_bit == 1 && display[ny][nx] == 0) V[0xF] = 1;
+inline std::uint64_t Chip8::draw_plane(Chip8Display& plane, const std::uint8_t* sprite, int x, int y, int rows, int row_bytes)
+{
+    int visible_rows = std::min(rows, display_height() - y);
+    std::uint64_t* row = &plane[y * CHIP8_ROW_WORDS];
+    std::uint64_t collision = 0;
+    std::uint64_t rows_drawn = 0;
+    if (!hires && row_bytes == 1)
+    {
+        // low resolution only uses the first word, bits shifted past the right edge are clipped
+        for (int dy = 0; dy < visible_rows; dy++, row += CHIP8_ROW_WORDS)
+        {
+            std::uint64_t sprite_row = ((std::uint64_t)sprite[dy] << 56) >> x;
+            collision |= row[0] & sprite_row;
+            row[0] ^= sprite_row;
+            if (sprite_row != 0) rows_drawn |= 1ull << dy;
+        }
+    }
+    else
+    {
+        for (int dy = 0; dy < visible_rows; dy++, row += CHIP8_ROW_WORDS)
+        {
+            // sprite row with its leftmost pixel in the MSB, split across the two words of the display row
+            std::uint64_t bits = (std::uint64_t)sprite[dy * row_bytes] << 56;
+            if (row_bytes == 2) bits |= (std::uint64_t)sprite[dy * row_bytes + 1] << 48;
+            std::uint64_t left = x < 64 ? bits >> x : 0;
+            std::uint64_t right = x == 0 ? 0 : x < 64 ? bits << (64 - x) : bits >> (x - 64);
+            if (!hires) right = 0;
+            collision |= (row[0] & left) | (row[1] & right);
+            row[0] ^= left;
+            row[1] ^= right;
+            if ((left | right) != 0) rows_drawn |= 1ull << dy;
         }
     }
+    dirty_rows |= rows_drawn << y;
+    return collision;
+}
+
+void Chip8::set_resolution(bool hires)
+{
+    // switching clears the screen, as in modern interpreters
+    this->hires = hires;
+    display = {};
+    display_generation++;
+    dirty_rows = ~0ull;
+}
+
+int Chip8::display_width() const
+{
+    return hires ? CHIP8_HIRES_WIDTH : CHIP8_DISPLAY_WIDTH;
+}
+
+int Chip8::display_height() const
+{
+    return hires ? CHIP8_HIRES_HEIGHT : CHIP8_DISPLAY_HEIGHT;
 }
 
 void Chip8::press_key(int key)
@@ -304,11 +1076,33 @@ void  Chip8::release_key(int key)
     }
 }
 
-std::array<std::array<bool, CHIP8_DISPLAY_WIDTH>, CHIP8_DISPLAY_HEIGHT> Chip8::get_display()
+const Chip8Display& Chip8::get_display() const
+{
+    return display[0];
+}
+
+const Chip8Planes& Chip8::get_planes() const
 {
     return display;
 }
 
+bool Chip8::is_hires() const
+{
+    return hires;
+}
+
+std::uint64_t Chip8::get_display_generation() const
+{
+    return display_generation;
+}
+
+std::uint64_t Chip8::consume_dirty_rows()
+{
+    std::uint64_t rows = dirty_rows;
+    dirty_rows = 0;
+    return rows;
+}
+
 bool Chip8::get_sound()
 {
     return timer_sound > 0;
@@ -316,40 +1110,206 @@ bool Chip8::get_sound()
 
 void Chip8::raise(Chip8::Exception e)
 {
-    switch (e)
+    exception = e;
+    if (trap_log != nullptr)
     {
-    case Chip8::Exception::INVALID_INSTRUCTION:
-        
-        break;
-    case Chip8::Exception::STACK_UNDERFLOW:
-        
-        break;
-    case Chip8::Exception::MEMORY_OUT_OF_BOUNDS:
-        
-        break;
-    case Chip8::Exception::INPUT_OUT_OF_BOUNDS:
-        
-        break;
-    default:
-        
-        break;
-    }
-    mem_dump(std::cerr);
+        mem_dump(*trap_log);
+    }
     interrupt = true;
 }
 
+const char* Chip8::exception_name(Chip8::Exception e)
+{
+    switch (e)
+    {
+    case Chip8::Exception::INVALID_INSTRUCTION: return "INVALID_INSTRUCTION";
+    case Chip8::Exception::STACK_UNDERFLOW: return "STACK_UNDERFLOW";
+    case Chip8::Exception::MEMORY_OUT_OF_BOUNDS: return "MEMORY_OUT_OF_BOUNDS";
+    case Chip8::Exception::INPUT_OUT_OF_BOUNDS: return "INPUT_OUT_OF_BOUNDS";
+    case Chip8::Exception::STACK_OVERFLOW: return "STACK_OVERFLOW";
+    case Chip8::Exception::EXIT: return "EXIT";
+    default: return "UNKNOWN";
+    }
+}
+
+bool Chip8::is_waiting_for_key()
+{
+    return block >= 0 && !interrupt;
+}
+
+bool Chip8::is_interrupted()
+{
+    return interrupt;
+}
+
+Chip8::Exception Chip8::get_exception()
+{
+    return exception;
+}
+
+std::uint64_t Chip8::get_instruction_count()
+{
+    return instruction_count;
+}
+
+void Chip8::set_trap_log(std::ostream* out)
+{
+    trap_log = out;
+}
+
+void Chip8::use_interpreter()
+{
+#ifdef CHIP8_JIT
+    jit.reset();
+#endif
+#ifdef CHIP8_AOT
+    aot.reset();
+#endif
+}
+
+void Chip8::set_sound_log(std::vector<SoundEdge>* out)
+{
+    sound_log = out;
+    sound_logged = false;
+    log_sound(cycle_count);
+}
+
+std::uint64_t Chip8::get_cycle_count()
+{
+    return cycle_count;
+}
+
+void Chip8::log_sound(std::uint64_t cycle)
+{
+    bool on = timer_sound > 0;
+    if (sound_log == nullptr || on == sound_logged) return;
+    sound_log->push_back({cycle, on});
+    sound_logged = on;
+}
+
+void Chip8::seed(std::uint64_t seed)
+{
+    RNG_seed = seed;
+    RNG.seed(seed);
+}
+
+std::uint64_t Chip8::get_seed()
+{
+    return RNG_seed;
+}
+
+void Chip8::set_clock_rate(std::int64_t hz)
+{
+    if (hz > 0)
+    {
+        clock_hz = hz;
+        clock_remainder = 0;
+        timer_phase = 0;
+    }
+}
+
+std::int64_t Chip8::get_clock_rate()
+{
+    return clock_hz;
+}
+
+void Chip8::set_variant(Variant variant)
+{
+    this->variant = variant;
+    apply_variant();
+    init();
+}
+
+Chip8::Variant Chip8::get_variant()
+{
+    return variant;
+}
+
+void Chip8::save_state(State& out) const
+{
+    out.magic = State::MAGIC;
+    out.version = State::VERSION;
+    out.variant = (std::uint8_t)variant;
+    memcpy(out.MEM, MEM, sizeof MEM);
+    memcpy(out.V, V, sizeof V);
+    out.I = I;
+    out.PC = PC;
+    out.current_PC = current_PC;
+    memcpy(out.exec_stack, exec_stack, sizeof exec_stack);
+    out.exec_stack_size = exec_stack_size;
+    out.timer_delay = timer_delay;
+    out.timer_sound = timer_sound;
+    for (int key = 0; key < 16; key++) out.key_reg[key] = key_reg[key];
+    out.block = block;
+    out.interrupt = interrupt;
+    out.exception = (std::uint8_t)exception;
+    for (int p = 0; p < CHIP8_PLANES; p++) memcpy(out.display[p], display[p].data(), sizeof out.display[p]);
+    out.hires = hires;
+    out.plane_mask = plane_mask;
+    memcpy(out.flags, flags, sizeof flags);
+    memcpy(out.audio_pattern, audio_pattern, sizeof audio_pattern);
+    out.pitch = pitch;
+    out.clock_remainder = clock_remainder;
+    out.timer_phase = timer_phase;
+    out.instruction_count = instruction_count;
+    out.RNG = RNG;
+}
+
+bool Chip8::load_state(const State& in)
+{
+    if (in.magic != State::MAGIC || in.version != State::VERSION) return false;
+    if (in.variant > (std::uint8_t)Variant::XO_CHIP) return false;
+    if (in.block < -1 || in.block > 15) return false; // press_key() writes V[block]
+    if (in.variant != (std::uint8_t)variant)
+    {
+        variant = (Variant)in.variant;
+        apply_variant();
+    }
+    memcpy(MEM, in.MEM, sizeof MEM);
+    invalidate_decode(0, sizeof MEM);
+#ifdef CHIP8_AOT
+    if (aot) aot->revalidate();
+#endif
+    memcpy(V, in.V, sizeof V);
+    I = in.I;
+    PC = in.PC;
+    current_PC = in.current_PC;
+    memcpy(exec_stack, in.exec_stack, sizeof exec_stack);
+    exec_stack_size = std::min<int>(in.exec_stack_size, stack_depth);
+    timer_delay = in.timer_delay;
+    timer_sound = in.timer_sound;
+    for (int key = 0; key < 16; key++) key_reg[key] = in.key_reg[key] != 0;
+    block = in.block;
+    interrupt = in.interrupt != 0;
+    exception = (Chip8::Exception)in.exception;
+    for (int p = 0; p < CHIP8_PLANES; p++) memcpy(display[p].data(), in.display[p], sizeof in.display[p]);
+    hires = in.hires != 0;
+    plane_mask = in.plane_mask & ((1 << CHIP8_PLANES) - 1);
+    memcpy(flags, in.flags, sizeof flags);
+    memcpy(audio_pattern, in.audio_pattern, sizeof audio_pattern);
+    pitch = in.pitch;
+    display_generation++;
+    dirty_rows = ~0ull;
+    clock_remainder = in.clock_remainder;
+    timer_phase = in.timer_phase % clock_hz; // the state may come from a machine with another clock rate
+    instruction_count = in.instruction_count;
+    RNG = in.RNG;
+    log_sound(cycle_count);
+    return true;
+}
+
 void Chip8::mem_dump(std::ostream& out)
 {
     out << "at PC:0x" << std::hex << std::setfill('0') << std::setw(3) << (int)current_PC << ":" 
         << std::setw(2) << (int)MEM[current_PC] 
-        << std::setw(2) << (int)MEM[current_PC + 1] << std::endl;
+        << std::setw(2) << (int)MEM[(current_PC + 1) % XOCHIP_MEMORY_SIZE] << std::endl;
     out << std::setw(3) << std::left << std::setfill(' ') << "MEM" << "\t";
     out << std::right;
     for (int i = 0x0; i < 0x10; i += 2)
         out << std::setw(4) << std::hex << i << " ";
     out << std::endl;
 
-    for (int adr = 0x200; adr < 4096;)
+    for (int adr = 0x200; adr < mem_size;)
     {
         out << std::hex << std::setfill('0') 
             << std::setw(3) << adr << "\t";
@@ -363,4 +1323,77 @@ void Chip8::mem_dump(std::ostream& out)
         }
         out << std::endl;
     }
-}
\ No newline at end of file
+}
+#ifdef CHIP8_PROFILE
+void Chip8::profile_instruction(const Decoded& d)
+{
+    profile->op_count[d.op]++;
+    profile->pc_count[current_PC]++;
+    profile->depth_count[exec_stack_size]++;
+    if (exec_stack_size > 0) profile->self_count[profile->frame_target[exec_stack_size - 1]]++;
+    if (d.op == OP_2NNN)
+    {
+        profile->call_count[d.NNN]++;
+        if (exec_stack_size < stack_depth)
+        {
+            profile->frame_target[exec_stack_size] = d.NNN;
+            profile->max_depth = std::max(profile->max_depth, exec_stack_size + 1);
+        }
+    }
+}
+
+void Chip8::profile_report(std::ostream& out)
+{
+    static const char* const op_names[] = {
+        "invalid", "00E0", "00EE", "00CN", "00DN", "00FB", "00FC", "00FD", "00FE", "00FF", "1NNN", "2NNN", "3XNN", "4XNN",
+        "5XY0", "5XY2", "5XY3", "6XNN", "7XNN", "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE", "9XY0",
+        "ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1", "F000", "FN01", "F002", "FX07", "FX0A", "FX15", "FX18",
+        "FX1E", "FX29", "FX30", "FX33", "FX3A", "FX55", "FX65", "FX75", "FX85"
+    };
+    static_assert(sizeof op_names / sizeof op_names[0] == OP_COUNT, "one name per Op");
+    const int top = 20;
+    std::uint64_t total = 0;
+    for (std::uint64_t count : profile->op_count) total += count;
+    if (total == 0) return;
+    auto percent = [total](std::uint64_t count) { return 100.0 * count / total; };
+    // indices of the nonzero entries of counts, largest first, at most limit of them
+    auto ranked = [](const std::uint64_t* counts, int size, int limit)
+    {
+        std::vector<int> order;
+        for (int i = 0; i < size; i++)
+        {
+            if (counts[i] > 0) order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [counts](int a, int b) { return counts[a] > counts[b]; });
+        if ((int)order.size() > limit) order.resize(limit);
+        return order;
+    };
+
+    std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+    out << "--- CHIP-8 profile: " << total << " instructions ---" << std::endl;
+    out << "opcode, count, %" << std::endl;
+    for (int op : ranked(profile->op_count, OP_COUNT, OP_COUNT))
+    {
+        out << op_names[op] << ", " << profile->op_count[op] << ", " << percent(profile->op_count[op]) << std::endl;
+    }
+    out << "hot PCs: address, instruction, count, %" << std::endl;
+    for (int pc : ranked(profile->pc_count, mem_size, top))
+    {
+        out << std::hex << std::setfill('0') << std::setw(3) << pc << ", " << std::setw(4) << ((MEM[pc] << 8) | MEM[pc + 1])
+            << std::dec << std::setfill(' ') << ", " << profile->pc_count[pc] << ", " << percent(profile->pc_count[pc]) << std::endl;
+    }
+    out << "subroutines: address, calls, self instructions, %" << std::endl;
+    for (int addr : ranked(profile->self_count, mem_size, top))
+    {
+        out << std::hex << std::setfill('0') << std::setw(3) << addr << std::dec << std::setfill(' ')
+            << ", " << profile->call_count[addr] << ", " << profile->self_count[addr] << ", " << percent(profile->self_count[addr]) << std::endl;
+    }
+    out << "call depth: depth, instructions, % (max depth " << profile->max_depth << ")" << std::endl;
+    for (int depth = 0; depth <= profile->max_depth; depth++)
+    {
+        out << depth << ", " << profile->depth_count[depth] << ", " << percent(profile->depth_count[depth]) << std::endl;
+    }
+    out.flags(flags);
+}
+#endif
@@ -4,14 +4,38 @@
 #include <cstring>
 #include <iostream>
 #include <iomanip>
-#include <stack>
+#include <type_traits>
 #include <array>
+#include <algorithm>
 #include <vector>
 #include <random>
+#include <memory>
 #include <SFML/System.hpp>
+#include "pcg32.h"
 
-const int CHIP8_DISPLAY_WIDTH = 64;
+const int CHIP8_DISPLAY_WIDTH = 64; // low resolution
 const int CHIP8_DISPLAY_HEIGHT = 32;
+const int CHIP8_HIRES_WIDTH = 128; // SUPER-CHIP high resolution
+const int CHIP8_HIRES_HEIGHT = 64;
+const int CHIP8_ROW_WORDS = 2; // words per display row, pixels 0-63 then 64-127
+// Row y is words 2y and 2y + 1, leftmost pixel in the MSB. In low resolution only rows 0-31 and their first word are used.
+using Chip8Display = std::array<std::uint64_t, CHIP8_HIRES_HEIGHT * CHIP8_ROW_WORDS>;
+static_assert(CHIP8_HIRES_HEIGHT <= 64, "dirty row mask holds one bit per row");
+// XO-CHIP draws on two bit planes, the colour of a pixel is its bit in plane 0 plus twice its bit in plane 1.
+// Every other variant only uses plane 0.
+const int CHIP8_PLANES = 2;
+using Chip8Planes = std::array<Chip8Display, CHIP8_PLANES>;
+const int CHIP8_MEMORY_SIZE = 0x1000;
+const int XOCHIP_MEMORY_SIZE = 0x10000;
+
+#ifdef CHIP8_JIT
+class Chip8Jit;
+#endif
+#ifdef CHIP8_AOT
+class Chip8Aot;
+#endif
+class Chip8Batch;
+class Chip8Analysis;
 
 class Chip8
 {
@@ -22,18 +46,96 @@ public:
         STACK_UNDERFLOW,
         MEMORY_OUT_OF_BOUNDS,
         INPUT_OUT_OF_BOUNDS,
+        STACK_OVERFLOW,
+        EXIT, // 00FD, the program ended itself
+    };
+    enum class Variant
+    {
+        SUPER_CHIP, // CHIP-8 with the SUPER-CHIP extensions, 4 KB of memory
+        XO_CHIP, // SUPER-CHIP plus 64 KB of memory, F000 NNNN, two bit planes (FN01), 5XY2/5XY3, 00DN and audio patterns
+    };
+    static const int stack_depth = 16;
+    // The sound output switching on or off, at the emulated cycle it happened.
+    struct SoundEdge
+    {
+        std::uint64_t cycle;
+        bool on;
+    };
+
+    // Complete machine state as a fixed-size, versioned blob of plain bytes.
+    // It can be written out with one write() and read back with one memcpy.
+    struct State
+    {
+        static const std::uint32_t MAGIC = 0x54533843; // "C8ST"
+        static const std::uint32_t VERSION = 5;
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint8_t variant;
+        std::uint8_t MEM[XOCHIP_MEMORY_SIZE]; // only the first 4 KB are used outside XO-CHIP
+        std::uint8_t V[16];
+        std::uint16_t I;
+        std::uint16_t PC;
+        std::uint16_t current_PC;
+        std::uint16_t exec_stack[stack_depth];
+        std::uint8_t exec_stack_size;
+        std::uint8_t timer_delay;
+        std::uint8_t timer_sound;
+        std::uint8_t key_reg[16];
+        std::int8_t block;
+        std::uint8_t interrupt;
+        std::uint8_t exception;
+        std::uint64_t display[CHIP8_PLANES][CHIP8_HIRES_HEIGHT * CHIP8_ROW_WORDS];
+        std::uint8_t hires;
+        std::uint8_t plane_mask;
+        std::uint8_t flags[16];
+        std::uint8_t audio_pattern[16];
+        std::uint8_t pitch;
+        std::int64_t clock_remainder;
+        std::int64_t timer_phase;
+        std::uint64_t instruction_count;
+        Pcg32 RNG;
     };
+
     Chip8();
     ~Chip8();
+    Chip8(const Chip8&) = delete;
+    Chip8& operator=(const Chip8&) = delete;
     void init();
     void load_program(std::vector<std::uint8_t>& bytes, std::uint16_t loc = 0x200);
     void press_key(int);
     void release_key(int);
     void update(sf::Time delta_t); // update timers
-    std::array<std::array<bool, CHIP8_DISPLAY_WIDTH>, CHIP8_DISPLAY_HEIGHT>  get_display();
+    void run_cycles(std::int64_t cycles); // run instructions as fast as possible, timers follow the emulated time they take
+    const Chip8Display& get_display() const; // plane 0
+    const Chip8Planes& get_planes() const;
+    bool is_hires() const; // true in the SUPER-CHIP 128x64 mode, the display is 64x32 otherwise
+    std::uint64_t get_display_generation() const; // increases whenever the display may have changed
+    std::uint64_t consume_dirty_rows(); // bit y set if row y changed since the last call
     bool get_sound();
     void mem_dump(std::ostream& out);
+    bool is_interrupted(); // true once an exception has been raised
+    bool is_waiting_for_key(); // true while FX0A blocks execution until a key is pressed
+    Exception get_exception(); // the exception that interrupted execution
+    static const char* exception_name(Exception e);
+    std::uint64_t get_instruction_count(); // instructions executed since init()
+    void set_trap_log(std::ostream* out); // where to dump memory when an exception is raised, nullptr for nowhere
+    void set_sound_log(std::vector<SoundEdge>* out); // where to append sound edges, nullptr for nowhere
+    void use_interpreter(); // run every instruction through FDE(), also in JIT and AOT builds
+    std::uint64_t get_cycle_count(); // cycles run since the machine was created, including while blocked; not part of the state
+    void seed(std::uint64_t seed); // reseed the random number generator used by CXNN
+    std::uint64_t get_seed();
+    void set_clock_rate(std::int64_t hz); // instructions per second, kept across init()
+    std::int64_t get_clock_rate();
+    void set_variant(Variant variant); // resets the machine, kept across init()
+    Variant get_variant();
+    void save_state(State& out) const;
+    bool load_state(const State& in); // false if the blob is not a valid state of this version
+#ifdef CHIP8_PROFILE
+    void profile_report(std::ostream& out); // also written to std::cerr when the machine is destroyed
+#endif
 private:
+    friend class Chip8Batch;
+    friend class Chip8Analysis;
     class Instruction // a 16-bit CHIP-8 instruction
     {
     private:
@@ -60,18 +162,93 @@ private:
         inline std::uint16_t NNN() const {return raw_instruction & 0x0FFF;}
     };
 
+    // Decoded instruction kinds, one per handler
+    enum Op : std::uint8_t
+    {
+        OP_INVALID,
+        OP_00E0,
+        OP_00EE,
+        OP_00CN,
+        OP_00DN,
+        OP_00FB,
+        OP_00FC,
+        OP_00FD,
+        OP_00FE,
+        OP_00FF,
+        OP_1NNN,
+        OP_2NNN,
+        OP_3XNN,
+        OP_4XNN,
+        OP_5XY0,
+        OP_5XY2,
+        OP_5XY3,
+        OP_6XNN,
+        OP_7XNN,
+        OP_8XY0,
+        OP_8XY1,
+        OP_8XY2,
+        OP_8XY3,
+        OP_8XY4,
+        OP_8XY5,
+        OP_8XY6,
+        OP_8XY7,
+        OP_8XYE,
+        OP_9XY0,
+        OP_ANNN,
+        OP_BNNN,
+        OP_CXNN,
+        OP_DXYN,
+        OP_EX9E,
+        OP_EXA1,
+        OP_F000,
+        OP_FN01,
+        OP_F002,
+        OP_FX07,
+        OP_FX0A,
+        OP_FX15,
+        OP_FX18,
+        OP_FX1E,
+        OP_FX29,
+        OP_FX30,
+        OP_FX33,
+        OP_FX3A,
+        OP_FX55,
+        OP_FX65,
+        OP_FX75,
+        OP_FX85,
+        OP_COUNT
+    };
+
+    // Pre-decoded instruction: handler plus operands extracted once per address
+    struct Decoded;
+    typedef void (Chip8::*Handler)(const Decoded&);
+    struct Decoded
+    {
+        Handler handler; // nullptr when the entry has not been decoded yet
+        std::uint16_t NNN;
+        std::uint8_t X;
+        std::uint8_t Y;
+        std::uint8_t N;
+        std::uint8_t NN;
+        Op op;
+    };
+    static const Handler handlers[OP_COUNT];
+
     // emulation parameters
-    static const sf::Time one_over_60;
     std::uint16_t font_addr;
-    sf::Time clock_speed_t; // instructions per second 
-    sf::Time clock_elapsed_t;
-    sf::Time timer_elapsed_t;
-    static std::random_device RNG_random_device;
-    static std::mt19937 RNG_gen;
-    std::uniform_int_distribution<int> RNG_distrib;
+    std::uint16_t big_font_addr; // SUPER-CHIP 8x10 digits
+    // Scheduling is integer: update() turns wall time into cycles, and the 60 Hz timers
+    // tick after cycle ceil(k * clock_hz / 60) for the k-th tick.
+    std::int64_t clock_hz; // instructions per second
+    std::int64_t clock_remainder; // wall time not yet run, in microseconds * clock_hz, below 1000000
+    std::int64_t timer_phase; // cycles since the last timer tick, times 60, below clock_hz
+    Pcg32 RNG; // per instance, seeded from std::random_device unless seed() is called
+    std::uint64_t RNG_seed;
     
     // Memory unit
-    std::uint8_t MEM[4096];
+    Variant variant;
+    int mem_size; // CHIP8_MEMORY_SIZE, or XOCHIP_MEMORY_SIZE for XO-CHIP
+    std::uint8_t MEM[XOCHIP_MEMORY_SIZE];
 
     // Control unit
     std::uint16_t PC; // program counter
@@ -79,20 +256,146 @@ private:
     std::uint8_t timer_delay;
     std::uint8_t timer_sound;
     std::uint8_t V[16]; // 8-bit registers
-    std::stack<std::uint16_t> exec_stack;
+    std::uint16_t exec_stack[stack_depth];
+    int exec_stack_size;
     bool interrupt;
+    Exception exception;
+    std::ostream* trap_log;
+    std::vector<SoundEdge>* sound_log;
+    bool sound_logged; // sound level of the last edge appended to sound_log
+    std::uint64_t cycle_count;
+    void log_sound(std::uint64_t cycle); // append an edge if the sound level changed since the last one
+    std::uint64_t instruction_count;
     int block; // -1 means no block, non-negative values indicate the register in which to record a keypress (FX0A)
     void FDE();
+    const Decoded* fetch(); // nullptr if PC is out of bounds
+    void skip(); // skip the next instruction, which is 4 bytes long if it is an XO-CHIP F000 NNNN
+    std::uint16_t skip_target(std::uint16_t next) const; // address after the instruction at next
+    bool check_bounds(int addr, int num_bytes); // raises MEMORY_OUT_OF_BOUNDS unless [addr, addr + num_bytes) is in memory
+    std::int64_t execute(std::int64_t cycles); // run up to the given number of instructions, returns how many ran
+    void advance_timers(std::int64_t cycles); // move the timer phase forward, ticking the timers at each boundary
+    bool watch_timers; // set by run_cycles() while both timers are zero
+    bool timer_started; // set by FX15/FX18 when they start a timer while watch_timers is set
+    bool sound_switched; // set by FX18 when it turns the sound on or off, so the edge gets its exact cycle
+    int idle_loop_length; // set by 1NNN when it closes an idle loop of this many instructions
+    bool yield; // ends execute() early, set together with timer_started, sound_switched or idle_loop_length
+    int idle_loop_at(std::uint16_t pc) const; // length of the jump-to-self or delay timer wait closed by the 1NNN at pc, 0 if none
+#ifdef CHIP8_THREADED
+    std::int64_t execute_threaded(std::int64_t cycles);
+#endif
     void raise(Exception e);
 
+    // Decode cache, indexed by PC and sized to the memory of the variant. Entries are invalidated when memory they cover is written.
+    std::vector<Decoded> decode_cache;
+    static Decoded decode(const Instruction& ins, Variant variant);
+    void invalidate_decode(int addr, int num_bytes);
+    void apply_variant(); // size memory and the decode cache for the variant and drop everything decoded or compiled
+
+    // Instruction handlers
+    void op_invalid(const Decoded& d);
+    void op_00E0(const Decoded& d);
+    void op_00EE(const Decoded& d);
+    void op_00CN(const Decoded& d);
+    void op_00DN(const Decoded& d);
+    void op_00FB(const Decoded& d);
+    void op_00FC(const Decoded& d);
+    void op_00FD(const Decoded& d);
+    void op_00FE(const Decoded& d);
+    void op_00FF(const Decoded& d);
+    void op_1NNN(const Decoded& d);
+    void op_2NNN(const Decoded& d);
+    void op_3XNN(const Decoded& d);
+    void op_4XNN(const Decoded& d);
+    void op_5XY0(const Decoded& d);
+    void op_5XY2(const Decoded& d);
+    void op_5XY3(const Decoded& d);
+    void op_6XNN(const Decoded& d);
+    void op_7XNN(const Decoded& d);
+    void op_8XY0(const Decoded& d);
+    void op_8XY1(const Decoded& d);
+    void op_8XY2(const Decoded& d);
+    void op_8XY3(const Decoded& d);
+    void op_8XY4(const Decoded& d);
+    void op_8XY5(const Decoded& d);
+    void op_8XY6(const Decoded& d);
+    void op_8XY7(const Decoded& d);
+    void op_8XYE(const Decoded& d);
+    void op_9XY0(const Decoded& d);
+    void op_ANNN(const Decoded& d);
+    void op_BNNN(const Decoded& d);
+    void op_CXNN(const Decoded& d);
+    void op_DXYN(const Decoded& d);
+    void op_EX9E(const Decoded& d);
+    void op_EXA1(const Decoded& d);
+    void op_F000(const Decoded& d);
+    void op_FN01(const Decoded& d);
+    void op_F002(const Decoded& d);
+    void op_FX07(const Decoded& d);
+    void op_FX0A(const Decoded& d);
+    void op_FX15(const Decoded& d);
+    void op_FX18(const Decoded& d);
+    void op_FX1E(const Decoded& d);
+    void op_FX29(const Decoded& d);
+    void op_FX30(const Decoded& d);
+    void op_FX33(const Decoded& d);
+    void op_FX3A(const Decoded& d);
+    void op_FX55(const Decoded& d);
+    void op_FX65(const Decoded& d);
+    void op_FX75(const Decoded& d);
+    void op_FX85(const Decoded& d);
+
+#ifdef CHIP8_PROFILE
+    // Execution counters, updated for every instruction before it executes. The JIT is not used in profiling builds.
+    struct Profile
+    {
+        std::uint64_t op_count[OP_COUNT];
+        std::uint64_t pc_count[XOCHIP_MEMORY_SIZE];
+        std::uint64_t call_count[XOCHIP_MEMORY_SIZE]; // 2NNN executions per target address
+        std::uint64_t self_count[XOCHIP_MEMORY_SIZE]; // instructions executed in the subroutine at each address, excluding its callees
+        std::uint64_t depth_count[stack_depth + 1]; // instructions executed at each call depth
+        std::uint16_t frame_target[stack_depth]; // target of each active call
+        int max_depth;
+    };
+    std::unique_ptr<Profile> profile; // on the heap, the per-address counters cover the whole XO-CHIP address space
+    void profile_instruction(const Decoded& d);
+#endif
+
+#ifdef CHIP8_JIT
+    // Optional block compiler, FDE() stays the reference and fallback
+    friend class Chip8Jit;
+    std::unique_ptr<Chip8Jit> jit;
+#endif
+
+#ifdef CHIP8_AOT
+    // Blocks recompiled ahead of time for known ROMs, FDE() stays the reference and fallback
+    friend class Chip8Aot;
+    std::unique_ptr<Chip8Aot> aot;
+#endif
+
     std::uint16_t current_PC;
 
     // Input unit
     bool key_reg[16];
+    std::uint8_t flags[16]; // SUPER-CHIP user flags, saved and loaded by FX75/FX85
+
+    // Sound, XO-CHIP programs can load a 1-bit sample pattern (F002) and its playback rate (FX3A)
+    std::uint8_t audio_pattern[16];
+    std::uint8_t pitch;
 
     // Display
-    std::array<std::array<bool, CHIP8_DISPLAY_WIDTH>, CHIP8_DISPLAY_HEIGHT> display;
-    void display_sprite(int x, int y, int num_bytes);
+    Chip8Planes display; // pixel x of row y is bit (63 - x % 64) of word 2y + x / 64 of each plane
+    bool hires;
+    std::uint8_t plane_mask; // planes drawn, cleared and scrolled, bit p for plane p, set by FN01
+    std::uint64_t display_generation; // bumped by every instruction that draws, clears or scrolls, and by init()
+    std::uint64_t dirty_rows; // bit y set when row y changed, cleared by consume_dirty_rows()
+    void display_sprite(int x, int y, int num_bytes); // num_bytes 0 draws a 16x16 sprite
+    std::uint64_t draw_plane(Chip8Display& plane, const std::uint8_t* sprite, int x, int y, int rows, int row_bytes); // returns the collision bits
+    void scroll_vertical(int rows); // positive scrolls down
+    void set_resolution(bool hires);
+    int display_width() const;
+    int display_height() const;
 };
 
+static_assert(std::is_trivially_copyable<Chip8::State>::value, "Chip8::State must be copyable as raw bytes");
+
 #endif /* CHIP8 */
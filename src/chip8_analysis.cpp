@@ -0,0 +1,504 @@
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include "chip8_analysis.h"
+
+Chip8Analysis::Chip8Analysis(Chip8::Variant variant) : variant(variant)
+{
+    mem_size = variant == Chip8::Variant::XO_CHIP ? XOCHIP_MEMORY_SIZE : CHIP8_MEMORY_SIZE;
+    load_address = 0x200;
+    rom_size = 0;
+    call_depth = 0;
+}
+
+void Chip8Analysis::analyze(const std::vector<std::uint8_t>& bytes, std::uint16_t loc)
+{
+    load_address = loc;
+    rom_size = std::min<int>(bytes.size(), std::max(mem_size - loc, 0));
+    mem.assign(mem_size, 0);
+    std::copy(bytes.begin(), bytes.begin() + rom_size, mem.begin() + loc);
+    use.assign(mem_size, 0);
+    instruction.assign(mem_size, false);
+    leader.assign(mem_size, false);
+    block_index.assign(mem_size, -1);
+    blocks.clear();
+    subroutines.clear();
+    indirect_jumps.clear();
+    stores.clear();
+    call_depth = 0;
+    if (loc > mem_size - 2) return;
+
+    discover();
+    build_blocks();
+    propagate();
+    build_call_graph();
+}
+
+const std::vector<Chip8Analysis::Block>& Chip8Analysis::get_blocks() const
+{
+    return blocks;
+}
+
+const Chip8Analysis::Block* Chip8Analysis::block_at(int addr) const
+{
+    if (addr < 0 || addr >= mem_size || block_index[addr] < 0) return nullptr;
+    return &blocks[block_index[addr]];
+}
+
+const std::vector<Chip8Analysis::Subroutine>& Chip8Analysis::get_subroutines() const
+{
+    return subroutines;
+}
+
+const std::vector<std::uint16_t>& Chip8Analysis::get_indirect_jumps() const
+{
+    return indirect_jumps;
+}
+
+const std::vector<Chip8Analysis::Store>& Chip8Analysis::get_stores() const
+{
+    return stores;
+}
+
+std::uint8_t Chip8Analysis::byte_use(int addr) const
+{
+    if (addr < 0 || addr >= mem_size) return 0;
+    return use[addr];
+}
+
+std::uint8_t Chip8Analysis::get_byte(int addr) const
+{
+    if (addr < 0 || addr >= mem_size) return 0;
+    return mem[addr];
+}
+
+bool Chip8Analysis::is_instruction(int addr) const
+{
+    return addr >= 0 && addr < mem_size && instruction[addr];
+}
+
+int Chip8Analysis::max_call_depth() const
+{
+    return call_depth;
+}
+
+std::uint16_t Chip8Analysis::get_load_address() const
+{
+    return load_address;
+}
+
+int Chip8Analysis::get_rom_size() const
+{
+    return rom_size;
+}
+
+Chip8::Decoded Chip8Analysis::decode(int addr) const
+{
+    return Chip8::decode(Chip8::Instruction((mem[addr] << 8) | mem[addr + 1]), variant);
+}
+
+int Chip8Analysis::instruction_length(int addr) const
+{
+    return decode(addr).op == Chip8::OP_F000 ? 4 : 2;
+}
+
+int Chip8Analysis::skip_target(int next) const
+{
+    bool long_load = variant == Chip8::Variant::XO_CHIP && next < mem_size - 1 && mem[next] == 0xF0 && mem[next + 1] == 0x00;
+    return next + (long_load ? 4 : 2);
+}
+
+void Chip8Analysis::discover()
+{
+    // Each item starts a linear scan that ends at the first instruction that does not fall through.
+    std::vector<int> work;
+    auto add_leader = [&](int addr)
+    {
+        if (addr > mem_size - 2) return; // the interpreter traps there
+        leader[addr] = true;
+        work.push_back(addr);
+    };
+    add_leader(load_address);
+    while (!work.empty())
+    {
+        int pc = work.back();
+        work.pop_back();
+        while (pc <= mem_size - 2 && !instruction[pc])
+        {
+            Chip8::Decoded d = decode(pc);
+            int length = d.op == Chip8::OP_F000 ? 4 : 2;
+            instruction[pc] = true;
+            for (int i = 0; i < length && pc + i < mem_size; i++) use[pc + i] |= BYTE_CODE;
+            bool falls_through = false;
+            switch (d.op)
+            {
+                case Chip8::OP_1NNN:
+                    add_leader(d.NNN);
+                    break;
+                case Chip8::OP_2NNN:
+                    add_leader(d.NNN);
+                    add_leader(pc + 2);
+                    break;
+                case Chip8::OP_3XNN:
+                case Chip8::OP_4XNN:
+                case Chip8::OP_5XY0:
+                case Chip8::OP_9XY0:
+                case Chip8::OP_EX9E:
+                case Chip8::OP_EXA1:
+                    add_leader(pc + 2);
+                    if (pc + 2 <= mem_size - 2) add_leader(skip_target(pc + 2));
+                    break;
+                case Chip8::OP_BNNN:
+                    indirect_jumps.push_back(pc);
+                    break;
+                case Chip8::OP_00EE:
+                case Chip8::OP_00FD:
+                case Chip8::OP_INVALID:
+                    break;
+                default:
+                    falls_through = true;
+                    break;
+            }
+            if (!falls_through) break;
+            pc += length;
+            // running into code found by an earlier scan, which now has a block starting here
+            if (pc <= mem_size - 2 && instruction[pc]) leader[pc] = true;
+        }
+    }
+    std::sort(indirect_jumps.begin(), indirect_jumps.end());
+}
+
+void Chip8Analysis::build_blocks()
+{
+    for (int start = 0; start < mem_size; start++)
+    {
+        if (!leader[start] || !instruction[start]) continue;
+        Block block;
+        block.start = start;
+        block.length = 0;
+        block.callee = 0;
+        int pc = start;
+        while (true)
+        {
+            Chip8::Decoded d = decode(pc);
+            int length = d.op == Chip8::OP_F000 ? 4 : 2;
+            block.length++;
+            block.end = pc + length;
+            bool ends = true;
+            switch (d.op)
+            {
+                case Chip8::OP_1NNN:
+                    block.exit = Exit::JUMP;
+                    block.successors.push_back(d.NNN);
+                    break;
+                case Chip8::OP_2NNN:
+                    block.exit = Exit::CALL;
+                    block.callee = d.NNN;
+                    block.successors.push_back(pc + 2);
+                    break;
+                case Chip8::OP_3XNN:
+                case Chip8::OP_4XNN:
+                case Chip8::OP_5XY0:
+                case Chip8::OP_9XY0:
+                case Chip8::OP_EX9E:
+                case Chip8::OP_EXA1:
+                    block.exit = Exit::SKIP;
+                    block.successors.push_back(pc + 2);
+                    if (pc + 2 <= mem_size - 2) block.successors.push_back(skip_target(pc + 2));
+                    break;
+                case Chip8::OP_00EE:
+                    block.exit = Exit::RETURN;
+                    break;
+                case Chip8::OP_BNNN:
+                    block.exit = Exit::INDIRECT;
+                    break;
+                case Chip8::OP_00FD:
+                case Chip8::OP_INVALID:
+                    block.exit = Exit::STOP;
+                    break;
+                default:
+                    ends = false;
+                    break;
+            }
+            if (ends) break;
+            pc += length;
+            if (pc > mem_size - 2)
+            {
+                block.exit = Exit::STOP;
+                break;
+            }
+            if (leader[pc])
+            {
+                block.exit = Exit::FALLTHROUGH;
+                block.successors.push_back(pc);
+                break;
+            }
+        }
+        block_index[start] = blocks.size();
+        blocks.push_back(block);
+    }
+    // targets past the end of memory trap instead of starting a block
+    for (Block& block : blocks)
+    {
+        auto& s = block.successors;
+        s.erase(std::remove_if(s.begin(), s.end(), [&](int addr) {return addr >= mem_size || block_index[addr] < 0;}), s.end());
+    }
+}
+
+Chip8Analysis::Registers Chip8Analysis::meet(Registers a, Registers b)
+{
+    auto meet_value = [](int x, int y)
+    {
+        if (x == I_UNSET) return y;
+        if (y == I_UNSET || x == y) return x;
+        return I_UNKNOWN;
+    };
+    return {meet_value(a.I, b.I), meet_value(a.planes, b.planes)};
+}
+
+Chip8Analysis::Registers Chip8Analysis::transfer(Registers in, int pc, bool record)
+{
+    Chip8::Decoded d = decode(pc);
+    Registers out = in;
+    bool xo = variant == Chip8::Variant::XO_CHIP;
+    int range = std::abs(d.X - d.Y) + 1;
+    switch (d.op)
+    {
+        case Chip8::OP_ANNN:
+            out.I = d.NNN;
+            break;
+        case Chip8::OP_F000:
+            out.I = pc + 3 < mem_size ? (mem[pc + 2] << 8) | mem[pc + 3] : I_UNKNOWN;
+            break;
+        case Chip8::OP_FX1E:
+        case Chip8::OP_FX29: // the digit is not masked, so I can point past the font
+        case Chip8::OP_FX30:
+            out.I = I_UNKNOWN;
+            break;
+        case Chip8::OP_FN01:
+            out.planes = d.X & 3;
+            break;
+        case Chip8::OP_DXYN:
+            if (record)
+            {
+                // one sprite per selected plane, back to back
+                int planes = in.planes >= 0 ? ((in.planes & 1) + (in.planes >> 1)) : (xo ? CHIP8_PLANES : 1);
+                access(pc, in.I, (d.N == 0 ? 32 : d.N) * planes, false);
+            }
+            break;
+        case Chip8::OP_FX33:
+            if (record) access(pc, in.I, 3, true);
+            break;
+        case Chip8::OP_FX55:
+        case Chip8::OP_FX65:
+            if (record) access(pc, in.I, d.X + 1, d.op == Chip8::OP_FX55);
+            if (xo && in.I >= 0) out.I = (in.I + d.X + 1) & 0xFFFF;
+            break;
+        case Chip8::OP_5XY2:
+            if (record) access(pc, in.I, range, true);
+            break;
+        case Chip8::OP_5XY3:
+            if (record) access(pc, in.I, range, false);
+            break;
+        case Chip8::OP_F002:
+            if (record) access(pc, in.I, 16, false);
+            break;
+        default:
+            break;
+    }
+    return out;
+}
+
+void Chip8Analysis::access(int pc, int addr, int num_bytes, bool write)
+{
+    Store store = {static_cast<std::uint16_t>(pc), addr >= 0 ? addr : -1, num_bytes, false};
+    for (int a = addr; addr >= 0 && a < std::min(addr + num_bytes, mem_size); a++)
+    {
+        if (write && (use[a] & BYTE_CODE)) store.self_modifying = true;
+        use[a] |= write ? BYTE_WRITTEN : BYTE_READ;
+    }
+    if (write) stores.push_back(store);
+}
+
+void Chip8Analysis::propagate()
+{
+    if (blocks.empty()) return;
+    // Registers on entry to each block. Subroutines start with the meet over their call sites,
+    // and nothing is known about I or the planes after a call returns.
+    std::vector<Registers> in(blocks.size(), Registers{I_UNSET, I_UNSET});
+    std::vector<bool> queued(blocks.size(), false);
+    std::vector<int> work;
+    auto flow = [&](int addr, Registers r)
+    {
+        if (addr >= mem_size || block_index[addr] < 0) return;
+        int b = block_index[addr];
+        Registers merged = meet(in[b], r);
+        if (merged.I == in[b].I && merged.planes == in[b].planes) return;
+        in[b] = merged;
+        if (!queued[b])
+        {
+            queued[b] = true;
+            work.push_back(b);
+        }
+    };
+    flow(load_address, Registers{0, 1}); // as after Chip8::init()
+    while (!work.empty())
+    {
+        int b = work.back();
+        work.pop_back();
+        queued[b] = false;
+        const Block& block = blocks[b];
+        Registers r = in[b];
+        for (int pc = block.start; pc < block.end; pc += instruction_length(pc)) r = transfer(r, pc, false);
+        if (block.exit == Exit::CALL)
+        {
+            flow(block.callee, r);
+            if (!block.successors.empty()) flow(block.successors[0], Registers{I_UNKNOWN, I_UNKNOWN});
+            continue;
+        }
+        for (int s : block.successors) flow(s, r);
+    }
+    for (std::size_t b = 0; b < blocks.size(); b++)
+    {
+        Registers r = in[b];
+        if (r.I == I_UNSET) r = Registers{I_UNKNOWN, I_UNKNOWN};
+        for (int pc = blocks[b].start; pc < blocks[b].end; pc += instruction_length(pc)) r = transfer(r, pc, true);
+    }
+}
+
+void Chip8Analysis::build_call_graph()
+{
+    if (blocks.empty()) return;
+    std::vector<std::uint16_t> entries;
+    for (const Block& block : blocks)
+    {
+        if (block.exit == Exit::CALL && block_at(block.callee) != nullptr) entries.push_back(block.callee);
+    }
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+    entries.erase(std::remove(entries.begin(), entries.end(), load_address), entries.end());
+    entries.insert(entries.begin(), load_address);
+
+    std::vector<bool> seen(blocks.size());
+    for (std::uint16_t entry : entries)
+    {
+        Subroutine sub;
+        sub.entry = entry;
+        sub.returns = false;
+        std::fill(seen.begin(), seen.end(), false);
+        std::vector<int> work = {block_index[entry]};
+        seen[work[0]] = true;
+        while (!work.empty())
+        {
+            const Block& block = blocks[work.back()];
+            work.pop_back();
+            sub.blocks.push_back(block.start);
+            if (block.exit == Exit::RETURN) sub.returns = true;
+            if (block.exit == Exit::CALL && block_at(block.callee) != nullptr) sub.callees.push_back(block.callee);
+            for (int s : block.successors)
+            {
+                int b = block_index[s];
+                if (!seen[b])
+                {
+                    seen[b] = true;
+                    work.push_back(b);
+                }
+            }
+        }
+        std::sort(sub.blocks.begin(), sub.blocks.end());
+        std::sort(sub.callees.begin(), sub.callees.end());
+        sub.callees.erase(std::unique(sub.callees.begin(), sub.callees.end()), sub.callees.end());
+        subroutines.push_back(sub);
+    }
+
+    // Longest chain of calls from the main program, a cycle means the stack depth has no static bound.
+    std::vector<int> index(mem_size, -1);
+    for (std::size_t i = 0; i < subroutines.size(); i++) index[subroutines[i].entry] = i;
+    std::vector<int> depth(subroutines.size(), -1);
+    std::vector<std::uint8_t> state(subroutines.size(), 0); // 0 not visited, 1 on the current chain, 2 done
+    bool recursive = false;
+    std::function<int(int)> visit = [&](int s)
+    {
+        if (state[s] == 2) return depth[s];
+        if (state[s] == 1)
+        {
+            recursive = true;
+            return 0;
+        }
+        state[s] = 1;
+        int d = 0;
+        for (std::uint16_t callee : subroutines[s].callees) d = std::max(d, 1 + visit(index[callee]));
+        state[s] = 2;
+        depth[s] = d;
+        return d;
+    };
+    int d = visit(0);
+    call_depth = recursive ? -1 : d;
+}
+
+std::string Chip8Analysis::disassemble(int addr) const
+{
+    if (addr < 0 || addr > mem_size - 2) return "";
+    Chip8::Decoded d = decode(addr);
+    char text[32];
+    int X = d.X;
+    int Y = d.Y;
+    switch (d.op)
+    {
+        case Chip8::OP_00E0: snprintf(text, sizeof text, "CLS"); break;
+        case Chip8::OP_00EE: snprintf(text, sizeof text, "RET"); break;
+        case Chip8::OP_00CN: snprintf(text, sizeof text, "SCD %d", d.N); break;
+        case Chip8::OP_00DN: snprintf(text, sizeof text, "SCU %d", d.N); break;
+        case Chip8::OP_00FB: snprintf(text, sizeof text, "SCR"); break;
+        case Chip8::OP_00FC: snprintf(text, sizeof text, "SCL"); break;
+        case Chip8::OP_00FD: snprintf(text, sizeof text, "EXIT"); break;
+        case Chip8::OP_00FE: snprintf(text, sizeof text, "LOW"); break;
+        case Chip8::OP_00FF: snprintf(text, sizeof text, "HIGH"); break;
+        case Chip8::OP_1NNN: snprintf(text, sizeof text, "JP 0x%03X", d.NNN); break;
+        case Chip8::OP_2NNN: snprintf(text, sizeof text, "CALL 0x%03X", d.NNN); break;
+        case Chip8::OP_3XNN: snprintf(text, sizeof text, "SE V%X, 0x%02X", X, d.NN); break;
+        case Chip8::OP_4XNN: snprintf(text, sizeof text, "SNE V%X, 0x%02X", X, d.NN); break;
+        case Chip8::OP_5XY0: snprintf(text, sizeof text, "SE V%X, V%X", X, Y); break;
+        case Chip8::OP_5XY2: snprintf(text, sizeof text, "LD [I], V%X-V%X", X, Y); break;
+        case Chip8::OP_5XY3: snprintf(text, sizeof text, "LD V%X-V%X, [I]", X, Y); break;
+        case Chip8::OP_6XNN: snprintf(text, sizeof text, "LD V%X, 0x%02X", X, d.NN); break;
+        case Chip8::OP_7XNN: snprintf(text, sizeof text, "ADD V%X, 0x%02X", X, d.NN); break;
+        case Chip8::OP_8XY0: snprintf(text, sizeof text, "LD V%X, V%X", X, Y); break;
+        case Chip8::OP_8XY1: snprintf(text, sizeof text, "OR V%X, V%X", X, Y); break;
+        case Chip8::OP_8XY2: snprintf(text, sizeof text, "AND V%X, V%X", X, Y); break;
+        case Chip8::OP_8XY3: snprintf(text, sizeof text, "XOR V%X, V%X", X, Y); break;
+        case Chip8::OP_8XY4: snprintf(text, sizeof text, "ADD V%X, V%X", X, Y); break;
+        case Chip8::OP_8XY5: snprintf(text, sizeof text, "SUB V%X, V%X", X, Y); break;
+        case Chip8::OP_8XY6: snprintf(text, sizeof text, "SHR V%X, V%X", X, Y); break;
+        case Chip8::OP_8XY7: snprintf(text, sizeof text, "SUBN V%X, V%X", X, Y); break;
+        case Chip8::OP_8XYE: snprintf(text, sizeof text, "SHL V%X, V%X", X, Y); break;
+        case Chip8::OP_9XY0: snprintf(text, sizeof text, "SNE V%X, V%X", X, Y); break;
+        case Chip8::OP_ANNN: snprintf(text, sizeof text, "LD I, 0x%03X", d.NNN); break;
+        case Chip8::OP_BNNN: snprintf(text, sizeof text, "JP V%X, 0x%03X", X, d.NNN); break;
+        case Chip8::OP_CXNN: snprintf(text, sizeof text, "RND V%X, 0x%02X", X, d.NN); break;
+        case Chip8::OP_DXYN: snprintf(text, sizeof text, "DRW V%X, V%X, %d", X, Y, d.N); break;
+        case Chip8::OP_EX9E: snprintf(text, sizeof text, "SKP V%X", X); break;
+        case Chip8::OP_EXA1: snprintf(text, sizeof text, "SKNP V%X", X); break;
+        case Chip8::OP_F000:
+            if (addr + 3 < mem_size) snprintf(text, sizeof text, "LD I, 0x%04X", (mem[addr + 2] << 8) | mem[addr + 3]);
+            else snprintf(text, sizeof text, "LD I, ?");
+            break;
+        case Chip8::OP_FN01: snprintf(text, sizeof text, "PLANE %d", X); break;
+        case Chip8::OP_F002: snprintf(text, sizeof text, "AUDIO"); break;
+        case Chip8::OP_FX07: snprintf(text, sizeof text, "LD V%X, DT", X); break;
+        case Chip8::OP_FX0A: snprintf(text, sizeof text, "LD V%X, K", X); break;
+        case Chip8::OP_FX15: snprintf(text, sizeof text, "LD DT, V%X", X); break;
+        case Chip8::OP_FX18: snprintf(text, sizeof text, "LD ST, V%X", X); break;
+        case Chip8::OP_FX1E: snprintf(text, sizeof text, "ADD I, V%X", X); break;
+        case Chip8::OP_FX29: snprintf(text, sizeof text, "LD F, V%X", X); break;
+        case Chip8::OP_FX30: snprintf(text, sizeof text, "LD HF, V%X", X); break;
+        case Chip8::OP_FX33: snprintf(text, sizeof text, "LD B, V%X", X); break;
+        case Chip8::OP_FX3A: snprintf(text, sizeof text, "PITCH V%X", X); break;
+        case Chip8::OP_FX55: snprintf(text, sizeof text, "LD [I], V%X", X); break;
+        case Chip8::OP_FX65: snprintf(text, sizeof text, "LD V%X, [I]", X); break;
+        case Chip8::OP_FX75: snprintf(text, sizeof text, "LD R, V%X", X); break;
+        case Chip8::OP_FX85: snprintf(text, sizeof text, "LD V%X, R", X); break;
+        default: snprintf(text, sizeof text, "DW 0x%02X%02X", mem[addr], mem[addr + 1]); break;
+    }
+    return text;
+}
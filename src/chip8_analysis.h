@@ -0,0 +1,114 @@
+#ifndef CHIP8_ANALYSIS
+#define CHIP8_ANALYSIS
+#include <cstdint>
+#include <vector>
+#include <string>
+#include "chip8.h"
+
+/*
+Static analysis of a ROM, without running it.
+Instructions are discovered from the load address by following jumps (1NNN),
+calls (2NNN) and their return sites, and both outcomes of every skip, then
+split into basic blocks. A constant propagation of I over the blocks finds the
+sprites and data the program reads and the memory it writes, which separates
+code from data and flags stores into code. BNNN targets depend on V0..VF, so
+they are reported instead of followed, and code only reachable through them
+stays unknown.
+*/
+class Chip8Analysis
+{
+public:
+    // What a byte of memory is used for, a byte can be several at once
+    enum ByteUse : std::uint8_t
+    {
+        BYTE_CODE = 1, // part of a reachable instruction
+        BYTE_READ = 2, // read by DXYN, FX65, 5XY3 or F002
+        BYTE_WRITTEN = 4, // written by FX33, FX55 or 5XY2
+    };
+    // How a basic block ends
+    enum class Exit
+    {
+        FALLTHROUGH, // the next instruction starts another block
+        JUMP, // 1NNN
+        CALL, // 2NNN, continues at the return site
+        RETURN, // 00EE
+        SKIP, // 3XNN, 4XNN, 5XY0, 9XY0, EX9E, EXA1: the next instruction or the one after it
+        INDIRECT, // BNNN
+        STOP, // 00FD, an invalid instruction, or the end of memory
+    };
+    struct Block
+    {
+        std::uint16_t start;
+        int end; // address after the last instruction
+        int length; // instructions
+        Exit exit;
+        std::vector<int> successors; // starts of the blocks that can run next, in the same subroutine
+        std::uint16_t callee; // CALL only
+    };
+    struct Subroutine
+    {
+        std::uint16_t entry; // the load address for the main program
+        std::vector<std::uint16_t> blocks; // starts of the blocks reachable from the entry without entering a callee
+        std::vector<std::uint16_t> callees;
+        bool returns; // an 00EE is reachable
+    };
+    struct Store // an instruction that writes memory
+    {
+        std::uint16_t pc;
+        int addr; // first byte written, -1 when I is not known statically
+        int num_bytes;
+        bool self_modifying; // the written bytes include code
+    };
+
+    Chip8Analysis(Chip8::Variant variant = Chip8::Variant::SUPER_CHIP);
+    void analyze(const std::vector<std::uint8_t>& bytes, std::uint16_t loc = 0x200); // same layout as Chip8::load_program
+    const std::vector<Block>& get_blocks() const; // sorted by start address
+    const Block* block_at(int addr) const; // the block starting at addr, nullptr if none
+    const std::vector<Subroutine>& get_subroutines() const; // the main program first, then callees by address
+    const std::vector<std::uint16_t>& get_indirect_jumps() const; // addresses of reachable BNNN
+    const std::vector<Store>& get_stores() const;
+    std::uint8_t byte_use(int addr) const; // ByteUse bits
+    std::uint8_t get_byte(int addr) const; // the analyzed memory, 0 outside the ROM
+    bool is_instruction(int addr) const; // a reachable instruction starts at addr
+    int max_call_depth() const; // deepest chain of calls from the main program, -1 if a subroutine can call itself
+    std::string disassemble(int addr) const; // the instruction at addr, F000 NNNN includes its second word
+    int instruction_length(int addr) const; // 4 for XO-CHIP F000 NNNN, 2 otherwise
+    std::uint16_t get_load_address() const;
+    int get_rom_size() const;
+private:
+    // Value of I at a program point: an address, or one of these
+    static const int I_UNSET = -1; // no path has reached this point yet
+    static const int I_UNKNOWN = -2;
+    struct Registers
+    {
+        int I;
+        int planes; // plane mask, I_UNSET or I_UNKNOWN
+    };
+
+    Chip8::Variant variant;
+    int mem_size;
+    std::uint16_t load_address;
+    int rom_size;
+    std::vector<std::uint8_t> mem;
+    std::vector<std::uint8_t> use;
+    std::vector<bool> instruction;
+    std::vector<bool> leader;
+    std::vector<int> block_index; // index into blocks of the block starting at each address, -1 if none
+    std::vector<Block> blocks;
+    std::vector<Subroutine> subroutines;
+    std::vector<std::uint16_t> indirect_jumps;
+    std::vector<Store> stores;
+    int call_depth;
+
+    Chip8::Decoded decode(int addr) const;
+    int skip_target(int next) const; // same rule as Chip8::skip_target, without wrapping around
+    void discover(); // mark reachable instructions and block leaders
+    void build_blocks();
+    void propagate(); // constant propagation of I and the plane mask, records reads and stores
+    void build_call_graph();
+    static Registers meet(Registers a, Registers b);
+    Registers transfer(Registers in, int pc, bool record);
+    void access(int pc, int addr, int num_bytes, bool write);
+};
+
+#endif /* CHIP8_ANALYSIS */
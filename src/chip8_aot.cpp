@@ -0,0 +1,154 @@
+#include "chip8_aot.h"
+#ifdef CHIP8_AOT
+#include "chip8.h"
+
+Chip8Aot::Registration::Registration(const Program& program)
+{
+    registry().push_back(&program);
+}
+
+std::vector<const Chip8Aot::Program*>& Chip8Aot::registry()
+{
+    // a function local static, so registrations from other files can run before anything here is initialized
+    static std::vector<const Program*> programs;
+    return programs;
+}
+
+Chip8Aot::Chip8Aot(Chip8& chip8) :
+    V(chip8.V),
+    MEM(chip8.MEM),
+    I(chip8.I),
+    PC(chip8.PC),
+    current_PC(chip8.current_PC),
+    timer_delay(chip8.timer_delay),
+    keys(chip8.key_reg),
+    stack(chip8.exec_stack),
+    stack_size(chip8.exec_stack_size),
+    chip8(chip8)
+{
+    program = nullptr;
+    invalidated = false;
+}
+
+void Chip8Aot::attach(const std::vector<std::uint8_t>& bytes, std::uint16_t loc)
+{
+    program = nullptr;
+    for (const Program* candidate : registry())
+    {
+        if (candidate->variant == chip8.variant && candidate->load_address == loc
+            && candidate->rom_size == static_cast<int>(bytes.size())
+            && std::equal(bytes.begin(), bytes.end(), candidate->rom))
+        {
+            program = candidate;
+            break;
+        }
+    }
+    enable_blocks();
+}
+
+void Chip8Aot::detach()
+{
+    program = nullptr;
+    block_at.clear();
+    covered.clear();
+}
+
+void Chip8Aot::revalidate()
+{
+    enable_blocks();
+}
+
+bool Chip8Aot::is_attached() const
+{
+    return program != nullptr;
+}
+
+void Chip8Aot::decode_at(int addr)
+{
+    if (addr < 0 || addr > chip8.mem_size - 2 || chip8.decode_cache[addr].handler != nullptr) return;
+    chip8.decode_cache[addr] = Chip8::decode(Chip8::Instruction((MEM[addr] << 8) | MEM[addr + 1]), chip8.variant);
+}
+
+void Chip8Aot::enable_blocks()
+{
+    if (program != nullptr && program->variant != chip8.variant) program = nullptr;
+    if (program == nullptr)
+    {
+        detach();
+        return;
+    }
+    block_at.assign(chip8.mem_size, -1);
+    covered.assign(chip8.mem_size, false);
+    int rom_start = program->load_address;
+    int rom_end = rom_start + program->rom_size;
+    for (int b = 0; b < program->num_blocks; b++)
+    {
+        const Block& block = program->blocks[b];
+        if (block.end > chip8.mem_size) continue;
+        // the block was compiled from the ROM, and from zeros outside it
+        bool matches = true;
+        for (int addr = block.start; addr < block.end && matches; addr++)
+        {
+            std::uint8_t compiled = addr >= rom_start && addr < rom_end ? program->rom[addr - rom_start] : 0;
+            matches = MEM[addr] == compiled;
+        }
+        if (!matches) continue;
+        if (block.jump != 0)
+        {
+            decode_at(block.jump);
+            decode_at(block.jump - 2);
+            decode_at(block.jump - 4);
+            if (chip8.idle_loop_at(block.jump) != 0) continue;
+        }
+        block_at[block.start] = b;
+        std::fill(covered.begin() + block.start, covered.begin() + block.end, true);
+    }
+}
+
+void Chip8Aot::invalidate(int addr, int num_bytes)
+{
+    if (program == nullptr) return;
+    int first = std::max(addr, 0);
+    int last = std::min(addr + num_bytes, chip8.mem_size);
+    bool hit = false;
+    for (int a = first; a < last && !hit; a++) hit = covered[a];
+    if (!hit) return;
+    for (int b = 0; b < program->num_blocks; b++)
+    {
+        const Block& block = program->blocks[b];
+        if (block_at[block.start] == b && block.start < last && block.end > first)
+        {
+            block_at[block.start] = -1;
+            invalidated = true;
+        }
+    }
+}
+
+bool Chip8Aot::interpret(std::uint16_t pc)
+{
+    chip8.PC = pc;
+    invalidated = false;
+    chip8.FDE();
+    return chip8.interrupt || chip8.block >= 0 || chip8.yield || invalidated || chip8.PC != static_cast<std::uint16_t>(pc + 2);
+}
+
+std::int64_t Chip8Aot::execute(std::int64_t cycles)
+{
+    std::int64_t budget = cycles;
+    while (cycles > 0 && !chip8.interrupt && chip8.block < 0 && !chip8.yield)
+    {
+        std::uint16_t pc = chip8.PC;
+        int b = pc < block_at.size() ? block_at[pc] : -1;
+        if (b >= 0 && program->blocks[b].length <= cycles)
+        {
+            cycles -= program->blocks[b].code(*this);
+            continue;
+        }
+        // Near the end of the budget, and wherever nothing was compiled, the interpreter runs.
+        chip8.FDE();
+        cycles--;
+    }
+    return budget - cycles;
+}
+
+#endif /* CHIP8_AOT */
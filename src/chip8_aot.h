@@ -0,0 +1,82 @@
+#ifndef CHIP8_AOT_H
+#define CHIP8_AOT_H
+#ifdef CHIP8_AOT
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+
+/*
+Runs ROMs that were recompiled ahead of time into C++ by chip8_aot (tools/chip8_aot.cpp).
+Each generated translation unit registers a Program: the ROM it was compiled from and one
+native function per basic block. Loading a ROM that matches a registered program attaches
+it, and from then on execute() calls the compiled block at PC when there is one.
+Instructions that are not compiled natively (drawing, timers, keys, memory stores, ...)
+call back into Chip8::FDE(), so the interpreter remains the reference for their semantics.
+It also runs everything the compiler could not see statically: targets of BNNN, blocks
+that the ROM rewrites, and idle loops, which it skips faster than they can run.
+*/
+class Chip8Aot
+{
+public:
+    typedef int (*BlockFn)(Chip8Aot& m); // returns the number of instructions executed
+    struct Block
+    {
+        std::uint16_t start;
+        int end; // the compiled code depends on memory in [start, end)
+        int length; // instructions in the block
+        std::uint16_t jump; // address of the 1NNN that ends the block, 0 if it does not end in one
+        BlockFn code;
+    };
+    struct Program
+    {
+        const char* name;
+        Chip8::Variant variant;
+        std::uint16_t load_address;
+        const std::uint8_t* rom;
+        int rom_size;
+        const Block* blocks;
+        int num_blocks;
+    };
+    // A static Registration in a generated file makes its program available to every Chip8.
+    struct Registration
+    {
+        Registration(const Program& program);
+    };
+
+    Chip8Aot(Chip8& chip8);
+    Chip8Aot(const Chip8Aot&) = delete;
+    Chip8Aot& operator=(const Chip8Aot&) = delete;
+    void attach(const std::vector<std::uint8_t>& bytes, std::uint16_t loc); // select the program compiled from this ROM, if any
+    void detach();
+    void revalidate(); // memory was replaced, keep only the blocks that still match it
+    bool is_attached() const;
+    std::int64_t execute(std::int64_t cycles); // returns the number of instructions executed
+    void invalidate(int addr, int num_bytes); // memory in [addr, addr + num_bytes) was written
+
+    // Registers and memory of the machine, for compiled blocks
+    std::uint8_t* const V;
+    std::uint8_t* const MEM;
+    std::uint16_t& I;
+    std::uint16_t& PC;
+    std::uint16_t& current_PC;
+    std::uint8_t& timer_delay;
+    const bool* const keys;
+    std::uint16_t* const stack;
+    int& stack_size;
+    // Run the instruction at pc in the interpreter. True if the block must return: the instruction
+    // trapped, blocked, yielded, did not continue at pc + 2, or rewrote compiled code.
+    bool interpret(std::uint16_t pc);
+private:
+    Chip8& chip8;
+    const Program* program;
+    std::vector<int> block_at; // index of the enabled block starting at each address, -1 if none
+    std::vector<bool> covered; // memory some enabled block depends on, a superset after invalidations
+    bool invalidated; // set when a write disables a block, checked by interpret()
+
+    static std::vector<const Program*>& registry();
+    void enable_blocks(); // every block whose memory matches the ROM, except those ending in an idle loop
+    void decode_at(int addr); // fill the decode cache entry used by Chip8::idle_loop_at()
+};
+
+#endif /* CHIP8_AOT */
+#endif /* CHIP8_AOT_H */
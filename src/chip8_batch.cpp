@@ -0,0 +1,376 @@
+#include "chip8_batch.h"
+#include "chip8_jit.h"
+#include "chip8_aot.h"
+
+Chip8Batch::Chip8Batch(int num_lanes) : num_lanes(num_lanes)
+{
+    for (int lane = 0; lane < num_lanes; lane++)
+    {
+        lanes.emplace_back(new Chip8());
+        lanes.back()->set_trap_log(nullptr);
+#ifdef CHIP8_JIT
+        lanes.back()->jit.reset(); // lanes are only ever stepped through FDE()
+#endif
+#ifdef CHIP8_AOT
+        lanes.back()->aot.reset();
+#endif
+    }
+    for (auto& reg : V) reg.resize(num_lanes);
+    PC.resize(num_lanes);
+    current_PC.resize(num_lanes);
+    I.resize(num_lanes);
+    timer_delay.resize(num_lanes);
+    timer_sound.resize(num_lanes);
+    for (auto& row : display) row.resize(num_lanes);
+    for (int lane = 0; lane < num_lanes; lane++)
+    {
+        sync_from_lane(lane);
+    }
+    clock_hz = num_lanes > 0 ? lanes[0]->clock_hz : 700;
+    clock_remainder = 0;
+    timer_phase = 0;
+}
+
+Chip8Batch::~Chip8Batch()
+{
+
+}
+
+int Chip8Batch::size()
+{
+    return num_lanes;
+}
+
+void Chip8Batch::load_program(std::vector<std::uint8_t>& bytes, std::uint16_t loc)
+{
+    for (int lane = 0; lane < num_lanes; lane++)
+    {
+        lanes[lane]->load_program(bytes, loc);
+        sync_from_lane(lane);
+    }
+}
+
+void Chip8Batch::set_variant(Chip8::Variant variant)
+{
+    for (int lane = 0; lane < num_lanes; lane++)
+    {
+        lanes[lane]->set_variant(variant);
+        sync_from_lane(lane, true);
+    }
+}
+
+void Chip8Batch::seed(int lane, std::uint64_t seed)
+{
+    lanes[lane]->seed(seed);
+}
+
+std::uint64_t Chip8Batch::get_seed(int lane)
+{
+    return lanes[lane]->get_seed();
+}
+
+void Chip8Batch::press_key(int lane, int key)
+{
+    // FX0A writes the key into a register, so the lane's registers must be current.
+    sync_to_lane(lane);
+    lanes[lane]->press_key(key);
+    sync_from_lane(lane);
+}
+
+void Chip8Batch::release_key(int lane, int key)
+{
+    lanes[lane]->release_key(key);
+}
+
+void Chip8Batch::update(sf::Time delta_t)
+{
+    if (delta_t <= sf::Time::Zero) return;
+    clock_remainder += delta_t.asMicroseconds() * clock_hz;
+    std::int64_t cycles = clock_remainder / 1000000;
+    clock_remainder -= cycles * 1000000;
+    run_cycles(cycles);
+}
+
+void Chip8Batch::run_cycles(std::int64_t cycles)
+{
+    // same tick placement as Chip8::run_cycles
+    for (; cycles > 0; cycles--)
+    {
+        step();
+        timer_phase += 60;
+        while (timer_phase >= clock_hz)
+        {
+            for (int lane = 0; lane < num_lanes; lane++)
+            {
+                timer_delay[lane] = ((timer_delay[lane] > 0) ? timer_delay[lane] - 1 : 0);
+                timer_sound[lane] = ((timer_sound[lane] > 0) ? timer_sound[lane] - 1 : 0);
+            }
+            timer_phase -= clock_hz;
+        }
+    }
+}
+
+std::int64_t Chip8Batch::get_clock_rate()
+{
+    return clock_hz;
+}
+
+void Chip8Batch::step()
+{
+    if (step_lockstep()) return;
+    for (int lane = 0; lane < num_lanes; lane++)
+    {
+        if (!lanes[lane]->interrupt && lanes[lane]->block < 0)
+        {
+            step_lane(lane);
+        }
+    }
+}
+
+void Chip8Batch::step_lane(int lane)
+{
+    bool hires = lanes[lane]->hires;
+    sync_to_lane(lane);
+    lanes[lane]->FDE();
+    lanes[lane]->instruction_count++;
+    sync_from_lane(lane, lanes[lane]->hires != hires); // switching resolution clears every word
+}
+
+bool Chip8Batch::step_lockstep()
+{
+    if (num_lanes == 0) return false;
+    std::uint16_t pc = PC[0];
+    Chip8& first = *lanes[0];
+    if (pc > first.mem_size - 2) return false;
+    std::uint8_t ins_U = first.MEM[pc];
+    std::uint8_t ins_L = first.MEM[pc + 1];
+    for (int lane = 0; lane < num_lanes; lane++)
+    {
+        const Chip8& chip8 = *lanes[lane];
+        if (PC[lane] != pc || chip8.interrupt || chip8.block >= 0) return false;
+        if (chip8.MEM[pc] != ins_U || chip8.MEM[pc + 1] != ins_L) return false;
+    }
+    Chip8::Decoded& d = first.decode_cache[pc];
+    if (d.handler == nullptr)
+    {
+        d = Chip8::decode(Chip8::Instruction((ins_U << 8) | ins_L), first.variant);
+    }
+
+    const int n = num_lanes;
+    std::uint8_t* vx = V[d.X].data();
+    std::uint8_t* vy = V[d.Y].data();
+    std::uint8_t* vf = V[0xF].data();
+    std::uint16_t* pcs = PC.data();
+    std::uint16_t* is = I.data();
+    const std::uint16_t next = pc + 2;
+    bool advance = true; // false when the instruction sets PC itself
+    // Each case mirrors the statement order of the matching Chip8::op_ handler.
+    switch (d.op)
+    {
+        case Chip8::OP_00E0:
+            // only plane 0 is kept in structure-of-arrays form
+            for (int l = 0; l < n; l++) if (lanes[l]->plane_mask != 1) return false;
+            for (auto& row : display) std::fill(row.begin(), row.end(), 0);
+            break;
+        case Chip8::OP_00EE:
+            for (int l = 0; l < n; l++) if (lanes[l]->exec_stack_size == 0) return false;
+            for (int l = 0; l < n; l++)
+            {
+                Chip8& chip8 = *lanes[l];
+                pcs[l] = chip8.exec_stack[--chip8.exec_stack_size];
+            }
+            advance = false;
+            break;
+        case Chip8::OP_1NNN:
+            std::fill(PC.begin(), PC.end(), d.NNN);
+            advance = false;
+            break;
+        case Chip8::OP_2NNN:
+            for (int l = 0; l < n; l++) if (lanes[l]->exec_stack_size == Chip8::stack_depth) return false;
+            for (int l = 0; l < n; l++)
+            {
+                Chip8& chip8 = *lanes[l];
+                chip8.exec_stack[chip8.exec_stack_size++] = next;
+            }
+            std::fill(PC.begin(), PC.end(), d.NNN);
+            advance = false;
+            break;
+        case Chip8::OP_3XNN:
+            for (int l = 0; l < n; l++) pcs[l] = (vx[l] == d.NN) ? lanes[l]->skip_target(next) : next;
+            advance = false;
+            break;
+        case Chip8::OP_4XNN:
+            for (int l = 0; l < n; l++) pcs[l] = (vx[l] != d.NN) ? lanes[l]->skip_target(next) : next;
+            advance = false;
+            break;
+        case Chip8::OP_5XY0:
+            for (int l = 0; l < n; l++) pcs[l] = (vx[l] == vy[l]) ? lanes[l]->skip_target(next) : next;
+            advance = false;
+            break;
+        case Chip8::OP_9XY0:
+            for (int l = 0; l < n; l++) pcs[l] = (vx[l] != vy[l]) ? lanes[l]->skip_target(next) : next;
+            advance = false;
+            break;
+        case Chip8::OP_6XNN: for (int l = 0; l < n; l++) vx[l] = d.NN; break;
+        case Chip8::OP_7XNN: for (int l = 0; l < n; l++) vx[l] += d.NN; break;
+        case Chip8::OP_8XY0: for (int l = 0; l < n; l++) vx[l] = vy[l]; break;
+        case Chip8::OP_8XY1: for (int l = 0; l < n; l++) vx[l] |= vy[l]; break;
+        case Chip8::OP_8XY2: for (int l = 0; l < n; l++) vx[l] &= vy[l]; break;
+        case Chip8::OP_8XY3: for (int l = 0; l < n; l++) vx[l] ^= vy[l]; break;
+        case Chip8::OP_8XY4:
+            for (int l = 0; l < n; l++)
+            {
+                vf[l] = ((int)vx[l] + (int)vy[l] > 255) ? 1 : 0;
+                vx[l] += vy[l];
+            }
+            break;
+        case Chip8::OP_8XY5:
+            for (int l = 0; l < n; l++)
+            {
+                vf[l] = ((int)vx[l] > (int)vy[l]) ? 1 : 0;
+                vx[l] = vx[l] - vy[l];
+            }
+            break;
+        case Chip8::OP_8XY6:
+            for (int l = 0; l < n; l++)
+            {
+                vf[l] = (vx[l] & 1);
+                vx[l] = (vx[l] >> 1);
+            }
+            break;
+        case Chip8::OP_8XY7:
+            for (int l = 0; l < n; l++)
+            {
+                vf[l] = ((int)vy[l] > (int)vx[l]) ? 1 : 0;
+                vx[l] = vy[l] - vx[l];
+            }
+            break;
+        case Chip8::OP_8XYE:
+            for (int l = 0; l < n; l++)
+            {
+                vf[l] = (vx[l] >> 7);
+                vx[l] = (vx[l] << 1);
+            }
+            break;
+        case Chip8::OP_ANNN: std::fill(I.begin(), I.end(), d.NNN); break;
+        case Chip8::OP_BNNN:
+            for (int l = 0; l < n; l++) pcs[l] = d.NNN + vx[l];
+            advance = false;
+            break;
+        case Chip8::OP_DXYN:
+            // Lanes whose sprite runs past the end of memory trap, leave those to the interpreter,
+            // as well as 16x16 sprites, high resolution and XO-CHIP planes other than plane 0 alone.
+            if (d.N == 0) return false;
+            for (int l = 0; l < n; l++) if (is[l] + d.N > lanes[l]->mem_size || lanes[l]->hires || lanes[l]->plane_mask != 1) return false;
+            for (int l = 0; l < n; l++)
+            {
+                int x = vx[l] % CHIP8_DISPLAY_WIDTH;
+                int y = vy[l] % CHIP8_DISPLAY_HEIGHT;
+                const std::uint8_t* sprite = &lanes[l]->MEM[is[l]];
+                std::uint64_t collision = 0;
+                for (int dy = 0; dy < d.N && y + dy < CHIP8_DISPLAY_HEIGHT; dy++)
+                {
+                    std::uint64_t sprite_row = ((std::uint64_t)sprite[dy] << (CHIP8_DISPLAY_WIDTH - 8)) >> x;
+                    std::vector<std::uint64_t>& row = display[(y + dy) * CHIP8_ROW_WORDS];
+                    collision |= row[l] & sprite_row;
+                    row[l] ^= sprite_row;
+                }
+                vf[l] = (collision != 0) ? 1 : 0;
+            }
+            break;
+        case Chip8::OP_EX9E:
+            for (int l = 0; l < n; l++) pcs[l] = lanes[l]->key_reg[vx[l] & 0xF] ? lanes[l]->skip_target(next) : next;
+            advance = false;
+            break;
+        case Chip8::OP_EXA1:
+            for (int l = 0; l < n; l++) pcs[l] = !lanes[l]->key_reg[vx[l] & 0xF] ? lanes[l]->skip_target(next) : next;
+            advance = false;
+            break;
+        case Chip8::OP_FX07: for (int l = 0; l < n; l++) vx[l] = timer_delay[l]; break;
+        case Chip8::OP_FX15: for (int l = 0; l < n; l++) timer_delay[l] = vx[l]; break;
+        case Chip8::OP_FX18: for (int l = 0; l < n; l++) timer_sound[l] = vx[l]; break;
+        case Chip8::OP_FX1E: for (int l = 0; l < n; l++) is[l] += vx[l]; break;
+        case Chip8::OP_FX29: for (int l = 0; l < n; l++) is[l] = first.font_addr + vx[l] * 5; break;
+        default:
+            // memory writes, RNG, key waits and traps go through the per-lane interpreter
+            return false;
+    }
+    if (advance) std::fill(PC.begin(), PC.end(), next);
+    std::fill(current_PC.begin(), current_PC.end(), pc);
+    for (auto& lane : lanes)
+    {
+        lane->instruction_count++;
+    }
+    return true;
+}
+
+void Chip8Batch::sync_to_lane(int lane)
+{
+    Chip8& chip8 = *lanes[lane];
+    for (int x = 0; x < 16; x++) chip8.V[x] = V[x][lane];
+    chip8.PC = PC[lane];
+    chip8.current_PC = current_PC[lane];
+    chip8.I = I[lane];
+    chip8.timer_delay = timer_delay[lane];
+    chip8.timer_sound = timer_sound[lane];
+    // in low resolution only the first word of the first 32 rows is ever nonzero
+    int step = chip8.hires ? 1 : CHIP8_ROW_WORDS;
+    int words = chip8.hires ? chip8.display[0].size() : CHIP8_DISPLAY_HEIGHT * CHIP8_ROW_WORDS;
+    for (int w = 0; w < words; w += step) chip8.display[0][w] = display[w][lane];
+}
+
+void Chip8Batch::sync_from_lane(int lane, bool all_words)
+{
+    const Chip8& chip8 = *lanes[lane];
+    for (int x = 0; x < 16; x++) V[x][lane] = chip8.V[x];
+    PC[lane] = chip8.PC;
+    current_PC[lane] = chip8.current_PC;
+    I[lane] = chip8.I;
+    timer_delay[lane] = chip8.timer_delay;
+    timer_sound[lane] = chip8.timer_sound;
+    bool all = all_words || chip8.hires;
+    int step = all ? 1 : CHIP8_ROW_WORDS;
+    int words = all ? chip8.display[0].size() : CHIP8_DISPLAY_HEIGHT * CHIP8_ROW_WORDS;
+    for (int w = 0; w < words; w += step) display[w][lane] = chip8.display[0][w];
+}
+
+Chip8Display Chip8Batch::get_display(int lane, int plane)
+{
+    if (plane != 0) return lanes[lane]->display[plane]; // only touched by the per-lane interpreter
+    Chip8Display words;
+    for (std::size_t w = 0; w < words.size(); w++) words[w] = display[w][lane];
+    return words;
+}
+
+bool Chip8Batch::is_hires(int lane)
+{
+    return lanes[lane]->hires;
+}
+
+bool Chip8Batch::get_sound(int lane)
+{
+    return timer_sound[lane] > 0;
+}
+
+bool Chip8Batch::is_interrupted(int lane)
+{
+    return lanes[lane]->is_interrupted();
+}
+
+Chip8::Exception Chip8Batch::get_exception(int lane)
+{
+    return lanes[lane]->get_exception();
+}
+
+std::uint64_t Chip8Batch::get_instruction_count(int lane)
+{
+    return lanes[lane]->get_instruction_count();
+}
+
+void Chip8Batch::save_state(int lane, Chip8::State& out)
+{
+    sync_to_lane(lane);
+    lanes[lane]->clock_remainder = clock_remainder;
+    lanes[lane]->timer_phase = timer_phase;
+    lanes[lane]->save_state(out);
+}
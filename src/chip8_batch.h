@@ -0,0 +1,66 @@
+#ifndef CHIP8_BATCH
+#define CHIP8_BATCH
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <memory>
+#include <SFML/System.hpp>
+#include "chip8.h"
+
+/*
+Runs N copies of a CHIP-8 machine in lockstep.
+Registers, PCs, timers and framebuffers are kept in structure-of-arrays layout
+(one contiguous array per field, indexed by lane). When every lane is about to
+execute the same instruction, it is applied to all lanes in one loop. Otherwise
+each lane is stepped on its own through Chip8::FDE(), so results match the
+single-instance core exactly.
+*/
+class Chip8Batch
+{
+public:
+    Chip8Batch(int num_lanes);
+    ~Chip8Batch();
+    int size();
+    void load_program(std::vector<std::uint8_t>& bytes, std::uint16_t loc = 0x200); // same program in every lane
+    void set_variant(Chip8::Variant variant); // resets every lane
+    void seed(int lane, std::uint64_t seed);
+    std::uint64_t get_seed(int lane);
+    void press_key(int lane, int key);
+    void release_key(int lane, int key);
+    void update(sf::Time delta_t); // same semantics as Chip8::update, for every lane
+    void run_cycles(std::int64_t cycles); // same semantics as Chip8::run_cycles, for every lane
+    std::int64_t get_clock_rate();
+    Chip8Display get_display(int lane, int plane = 0);
+    bool is_hires(int lane);
+    bool get_sound(int lane);
+    bool is_interrupted(int lane);
+    Chip8::Exception get_exception(int lane);
+    std::uint64_t get_instruction_count(int lane);
+    void save_state(int lane, Chip8::State& out); // the lane as a single Chip8 would save it
+private:
+    int num_lanes;
+    // Per-lane machines hold memory, stack, keys and flags, and execute divergent instructions.
+    std::vector<std::unique_ptr<Chip8>> lanes;
+
+    // emulation parameters, shared by all lanes
+    std::int64_t clock_hz;
+    std::int64_t clock_remainder;
+    std::int64_t timer_phase;
+
+    // Structure-of-arrays state, each vector has one entry per lane
+    std::vector<std::uint8_t> V[16];
+    std::vector<std::uint16_t> PC;
+    std::vector<std::uint16_t> current_PC;
+    std::vector<std::uint16_t> I;
+    std::vector<std::uint8_t> timer_delay;
+    std::vector<std::uint8_t> timer_sound;
+    std::vector<std::uint64_t> display[CHIP8_HIRES_HEIGHT * CHIP8_ROW_WORDS]; // plane 0, same word layout as Chip8Display
+
+    void step(); // one instruction on every running lane
+    bool step_lockstep(); // false if the lanes diverge or the instruction has no vector form
+    void step_lane(int lane);
+    void sync_to_lane(int lane);
+    void sync_from_lane(int lane, bool all_words = false);
+};
+
+#endif /* CHIP8_BATCH */
@@ -0,0 +1,275 @@
+#include "chip8_jit.h"
+#ifdef CHIP8_JIT
+#include "chip8.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Minimal x86-64 encoder for the handful of instructions the block compiler needs.
+// rbx holds &V[0] for the whole block, rax/rcx/rdx are scratch.
+class X86Emitter
+{
+public:
+    X86Emitter(std::uint8_t* start) : p(start){};
+    std::uint8_t* p;
+    void byte(std::uint8_t b) {*p++ = b;}
+    void bytes(std::initializer_list<std::uint8_t> bs) {for (auto b : bs) byte(b);}
+    void imm16(std::uint16_t v) {memcpy(p, &v, 2); p += 2;}
+    void imm32(std::uint32_t v) {memcpy(p, &v, 4); p += 4;}
+    void imm64(std::uint64_t v) {memcpy(p, &v, 8); p += 8;}
+    void imm64(const void* ptr) {imm64((std::uint64_t)(std::uintptr_t)ptr);}
+
+    void prologue() {bytes({0x53, 0x48, 0x83, 0xEC, 0x20});} // push rbx; sub rsp, 32
+    void epilogue() {bytes({0x48, 0x83, 0xC4, 0x20, 0x5B, 0xC3});} // add rsp, 32; pop rbx; ret
+    void mov_rbx(const void* ptr) {bytes({0x48, 0xBB}); imm64(ptr);}
+    void mov_rax(const void* ptr) {bytes({0x48, 0xB8}); imm64(ptr);}
+    void mov_eax(std::uint32_t v) {byte(0xB8); imm32(v);}
+    void return_count(int count) {mov_eax(count); epilogue();}
+
+    // byte ops on V registers, addressed as [rbx + reg]
+    void mov_V_imm(int x, std::uint8_t v) {bytes({0xC6, 0x43, (std::uint8_t)x, v});}
+    void add_V_imm(int x, std::uint8_t v) {bytes({0x80, 0x43, (std::uint8_t)x, v});}
+    void mov_al_V(int x) {bytes({0x8A, 0x43, (std::uint8_t)x});}
+    void mov_cl_V(int x) {bytes({0x8A, 0x4B, (std::uint8_t)x});}
+    void mov_V_al(int x) {bytes({0x88, 0x43, (std::uint8_t)x});}
+    void mov_V_cl(int x) {bytes({0x88, 0x4B, (std::uint8_t)x});}
+    void alu_al_V(std::uint8_t op, int x) {bytes({op, 0x43, (std::uint8_t)x});} // op al, [rbx + x]
+
+    // word/byte stores through rax
+    void mov_word_rax_imm(std::uint16_t v) {bytes({0x66, 0xC7, 0x00}); imm16(v);}
+    void mov_byte_rax_cl() {bytes({0x88, 0x08});}
+    void mov_cl_byte_rax() {bytes({0x8A, 0x08});}
+};
+
+enum : std::uint8_t
+{
+    ALU_ADD = 0x02,
+    ALU_OR = 0x0A,
+    ALU_AND = 0x22,
+    ALU_SUB = 0x2A,
+    ALU_XOR = 0x32,
+    ALU_CMP = 0x3A,
+};
+
+Chip8Jit::Chip8Jit(Chip8& chip8) : chip8(chip8)
+{
+    code_size = 4 << 20;
+    code_used = 0;
+    // The buffer is never writable and executable at once: compile() makes the pages it emits
+    // into read-write, and read-execute again before the block runs.
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    page_size = info.dwPageSize;
+    code_buffer = (std::uint8_t*)VirtualAlloc(nullptr, code_size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READ);
+#else
+    page_size = sysconf(_SC_PAGESIZE);
+    void* mem = mmap(nullptr, code_size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    code_buffer = (mem == MAP_FAILED) ? nullptr : (std::uint8_t*)mem;
+#endif
+    flush();
+}
+
+Chip8Jit::~Chip8Jit()
+{
+    if (code_buffer == nullptr) return;
+#ifdef _WIN32
+    VirtualFree(code_buffer, 0, MEM_RELEASE);
+#else
+    munmap(code_buffer, code_size);
+#endif
+}
+
+void Chip8Jit::flush()
+{
+    for (auto& block : blocks)
+    {
+        block = {nullptr, 0, 0};
+    }
+    memset(invalidations, 0, sizeof invalidations);
+    code_used = 0;
+}
+
+void Chip8Jit::invalidate(int addr, int num_bytes)
+{
+    int first = std::max(addr - 2 * max_block_length, 0);
+    int last = std::min(addr + num_bytes, CHIP8_MEMORY_SIZE);
+    for (int start = first; start < last; start++)
+    {
+        Block& block = blocks[start];
+        if (block.code != nullptr && start + block.num_bytes > addr)
+        {
+            block = {nullptr, 0, 0};
+            if (invalidations[start] < 255) invalidations[start]++;
+        }
+    }
+}
+
+std::int64_t Chip8Jit::execute(std::int64_t cycles)
+{
+    std::int64_t budget = cycles;
+    while (cycles > 0 && !chip8.interrupt && chip8.block < 0 && !chip8.yield)
+    {
+        std::uint16_t pc = chip8.PC;
+        if (pc <= CHIP8_MEMORY_SIZE - 2 && code_buffer != nullptr)
+        {
+            Block& block = blocks[pc];
+            if (block.code == nullptr && invalidations[pc] < max_invalidations)
+            {
+                compile(pc);
+            }
+            if (block.code != nullptr && block.length <= cycles)
+            {
+                cycles -= block.code();
+                continue;
+            }
+        }
+        // Fall back to the interpreter near the end of the budget and for self-modifying code.
+        chip8.FDE();
+        cycles--;
+    }
+    return budget - cycles;
+}
+
+bool Chip8Jit::protect(std::size_t begin, std::size_t end, bool writable)
+{
+    begin -= begin % page_size;
+    end = std::min((end + page_size - 1) / page_size * page_size, code_size);
+#ifdef _WIN32
+    DWORD old_protection;
+    if (!VirtualProtect(code_buffer + begin, end - begin, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old_protection)) return false;
+    if (!writable) FlushInstructionCache(GetCurrentProcess(), code_buffer + begin, end - begin);
+    return true;
+#else
+    return mprotect(code_buffer + begin, end - begin, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+bool Chip8Jit::interpret(Chip8* chip8, std::uint32_t pc)
+{
+    chip8->PC = pc;
+    chip8->FDE();
+    return chip8->interrupt || chip8->block >= 0;
+}
+
+bool Chip8Jit::compile(std::uint16_t start)
+{
+    if (code_used + max_block_bytes > code_size) flush();
+    std::size_t block_begin = code_used;
+    if (!protect(block_begin, block_begin + max_block_bytes, true)) return false;
+    X86Emitter e(code_buffer + code_used);
+    e.prologue();
+    e.mov_rbx(chip8.V);
+
+    int length = 0;
+    std::uint16_t pc = start;
+    bool terminated = false;
+    while (!terminated && length < max_block_length && pc <= CHIP8_MEMORY_SIZE - 2)
+    {
+        Chip8::Decoded& d = chip8.decode_cache[pc];
+        if (d.handler == nullptr)
+        {
+            d = Chip8::decode(Chip8::Instruction((chip8.MEM[pc] << 8) | chip8.MEM[pc + 1]), chip8.variant);
+        }
+        Chip8::Handler h = d.handler;
+        length++;
+        // 8XYN flag ops read and write VF in an order that only the interpreter gets right when X or Y is F.
+        bool touches_VF = (d.X == 0xF || d.Y == 0xF);
+
+        if (h == &Chip8::op_6XNN) e.mov_V_imm(d.X, d.NN);
+        else if (h == &Chip8::op_7XNN) e.add_V_imm(d.X, d.NN);
+        else if (h == &Chip8::op_8XY0) {e.mov_al_V(d.Y); e.mov_V_al(d.X);}
+        else if (h == &Chip8::op_8XY1) {e.mov_al_V(d.X); e.alu_al_V(ALU_OR, d.Y); e.mov_V_al(d.X);}
+        else if (h == &Chip8::op_8XY2) {e.mov_al_V(d.X); e.alu_al_V(ALU_AND, d.Y); e.mov_V_al(d.X);}
+        else if (h == &Chip8::op_8XY3) {e.mov_al_V(d.X); e.alu_al_V(ALU_XOR, d.Y); e.mov_V_al(d.X);}
+        else if (h == &Chip8::op_8XY4 && !touches_VF)
+        {
+            e.mov_al_V(d.X); e.alu_al_V(ALU_ADD, d.Y);
+            e.bytes({0x0F, 0x92, 0xC1}); // setc cl
+            e.mov_V_cl(0xF); e.mov_V_al(d.X);
+        }
+        else if (h == &Chip8::op_8XY5 && !touches_VF)
+        {
+            e.mov_al_V(d.X); e.alu_al_V(ALU_CMP, d.Y);
+            e.bytes({0x0F, 0x97, 0xC1}); // seta cl
+            e.alu_al_V(ALU_SUB, d.Y);
+            e.mov_V_cl(0xF); e.mov_V_al(d.X);
+        }
+        else if (h == &Chip8::op_8XY7 && !touches_VF)
+        {
+            e.mov_al_V(d.Y); e.alu_al_V(ALU_CMP, d.X);
+            e.bytes({0x0F, 0x97, 0xC1}); // seta cl
+            e.alu_al_V(ALU_SUB, d.X);
+            e.mov_V_cl(0xF); e.mov_V_al(d.X);
+        }
+        else if (h == &Chip8::op_8XY6 && !touches_VF)
+        {
+            e.mov_al_V(d.X);
+            e.bytes({0x88, 0xC1, 0x80, 0xE1, 0x01, 0xD0, 0xE8}); // mov cl, al; and cl, 1; shr al, 1
+            e.mov_V_cl(0xF); e.mov_V_al(d.X);
+        }
+        else if (h == &Chip8::op_8XYE && !touches_VF)
+        {
+            e.mov_al_V(d.X);
+            e.bytes({0x88, 0xC1, 0xC0, 0xE9, 0x07, 0xD0, 0xE0}); // mov cl, al; shr cl, 7; shl al, 1
+            e.mov_V_cl(0xF); e.mov_V_al(d.X);
+        }
+        else if (h == &Chip8::op_ANNN) {e.mov_rax(&chip8.I); e.mov_word_rax_imm(d.NNN);}
+        else if (h == &Chip8::op_FX1E)
+        {
+            e.bytes({0x0F, 0xB6, 0x4B, d.X}); // movzx ecx, byte [rbx + X]
+            e.mov_rax(&chip8.I);
+            e.bytes({0x66, 0x01, 0x08}); // add word [rax], cx
+        }
+        else if (h == &Chip8::op_FX07) {e.mov_rax(&chip8.timer_delay); e.mov_cl_byte_rax(); e.mov_V_cl(d.X);}
+        else if (h == &Chip8::op_1NNN && chip8.idle_loop_at(pc) == 0) // idle loops go to the interpreter, which skips them
+        {
+            e.mov_rax(&chip8.current_PC); e.mov_word_rax_imm(pc);
+            e.mov_rax(&chip8.PC); e.mov_word_rax_imm(d.NNN);
+            e.return_count(length);
+            terminated = true;
+        }
+        else
+        {
+            // Call back into the interpreter for this instruction and leave early if it trapped or blocked.
+#ifdef _WIN32
+            e.bytes({0x48, 0xB9}); e.imm64(&chip8); // mov rcx, chip8
+            e.byte(0xBA); e.imm32(pc); // mov edx, pc
+#else
+            e.bytes({0x48, 0xBF}); e.imm64(&chip8); // mov rdi, chip8
+            e.byte(0xBE); e.imm32(pc); // mov esi, pc
+#endif
+            e.bytes({0x48, 0xB8}); e.imm64((std::uint64_t)(std::uintptr_t)&Chip8Jit::interpret); // mov rax, interpret
+            e.bytes({0xFF, 0xD0}); // call rax
+            terminated = !(h == &Chip8::op_00E0 || h == &Chip8::op_CXNN || h == &Chip8::op_DXYN
+                || h == &Chip8::op_FX29 || h == &Chip8::op_FX65 || h == &Chip8::op_8XY4 || h == &Chip8::op_8XY5
+                || h == &Chip8::op_8XY6 || h == &Chip8::op_8XY7 || h == &Chip8::op_8XYE);
+            if (terminated)
+            {
+                e.return_count(length); // the interpreter has already set PC
+            }
+            else
+            {
+                e.bytes({0x84, 0xC0, 0x74, 0x0B}); // test al, al; jz over the early exit
+                e.return_count(length);
+            }
+        }
+        pc += 2;
+    }
+    if (!terminated)
+    {
+        e.mov_rax(&chip8.current_PC); e.mov_word_rax_imm(pc - 2);
+        e.mov_rax(&chip8.PC); e.mov_word_rax_imm(pc);
+        e.return_count(length);
+    }
+
+    if (!protect(block_begin, block_begin + max_block_bytes, false)) return false;
+    blocks[start] = {(BlockFn)(code_buffer + code_used), length, pc - start};
+    code_used = ((e.p - code_buffer) + 15) & ~(std::size_t)15;
+    return true;
+}
+
+#endif /* CHIP8_JIT */
@@ -0,0 +1,56 @@
+#ifndef CHIP8_JIT_H
+#define CHIP8_JIT_H
+#ifdef CHIP8_JIT
+#if !(defined(__x86_64__) || defined(_M_X64))
+#error "CHIP8_JIT requires an x86-64 host"
+#endif
+#include <cstdint>
+#include <cstddef>
+#include "chip8.h"
+
+
+/*
+Translates straight-line runs of CHIP-8 instructions into x86-64 code.
+A block ends at the first instruction that changes control flow (jumps, calls,
+returns, skips, FX0A) or writes memory (FX33, FX55). Simple register operations
+are emitted natively, everything else calls back into Chip8::FDE(), so the
+interpreter remains the reference for instruction semantics.
+*/
+class Chip8Jit
+{
+public:
+    Chip8Jit(Chip8& chip8);
+    ~Chip8Jit();
+    Chip8Jit(const Chip8Jit&) = delete;
+    Chip8Jit& operator=(const Chip8Jit&) = delete;
+    std::int64_t execute(std::int64_t cycles); // returns the number of instructions executed
+    void invalidate(int addr, int num_bytes); // memory in [addr, addr + num_bytes) was written
+    void flush(); // drop all compiled blocks
+private:
+    typedef int (*BlockFn)(); // returns the number of instructions executed
+    struct Block
+    {
+        BlockFn code; // nullptr when not compiled
+        int length; // instructions in the block
+        int num_bytes; // CHIP-8 memory covered by the block
+    };
+    static const int max_block_length = 64;
+    static const int max_block_bytes = 64 * 48; // upper bound of emitted code per block
+    static const int max_invalidations = 8; // addresses rewritten more often than this are interpreted
+
+    Chip8& chip8;
+    std::uint8_t* code_buffer;
+    std::size_t code_size;
+    std::size_t code_used;
+    std::size_t page_size;
+    // only the first 4 KB are compiled, the rest of the XO-CHIP address space is interpreted
+    Block blocks[CHIP8_MEMORY_SIZE];
+    std::uint8_t invalidations[CHIP8_MEMORY_SIZE];
+
+    bool compile(std::uint16_t pc);
+    bool protect(std::size_t begin, std::size_t end, bool writable); // pages holding [begin, end) become read-write or read-execute
+    static bool interpret(Chip8* chip8, std::uint32_t pc);
+};
+
+#endif /* CHIP8_JIT */
+#endif /* CHIP8_JIT_H */
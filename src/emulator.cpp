@@ -0,0 +1,220 @@
+#include "emulator.h"
+#include <fstream>
+
+namespace
+{
+    const sf::Time frame_t = sf::microseconds(1000000 / 60);
+    const sf::Time step_t = sf::milliseconds(2); // emulation thread period while running
+    // fast-forward speeds (Tab toggles, Shift+Tab picks the speed), 0 means as fast as the host allows
+    const int turbo_speeds[] = {0, 2, 4, 8};
+    const int num_turbo_speeds = sizeof turbo_speeds / sizeof turbo_speeds[0];
+}
+
+Emulator::Emulator(std::vector<std::uint8_t>& rom, Beeper* beeper, Chip8::Variant variant) : rom(rom), beeper(beeper), running(false)
+{
+    chip8.set_variant(variant);
+    if (beeper != nullptr) chip8.set_sound_log(&sound_edges);
+    chip8.load_program(this->rom);
+    has_save = false;
+    rewinding = false;
+    turbo = false;
+    turbo_index = 0;
+    commands_done = 0;
+    unseen_rows = 0;
+    commands_sent = 0;
+    taken_rows = 0;
+}
+
+Emulator::~Emulator()
+{
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+void Emulator::start()
+{
+    publish();
+    frame();
+    running = true;
+    thread = std::thread(&Emulator::run, this);
+}
+
+void Emulator::send(const Command& command)
+{
+    // the queue only fills up if the emulation thread stalls, so wait for it rather than drop input
+    while (!commands.push(command))
+    {
+        std::this_thread::yield();
+    }
+    commands_sent++;
+}
+
+const Emulator::Frame& Emulator::frame()
+{
+    if (frames.update()) taken_rows |= frames.front().dirty_rows;
+    return frames.front();
+}
+
+std::uint64_t Emulator::consume_dirty_rows()
+{
+    std::uint64_t rows = taken_rows;
+    taken_rows = 0;
+    return rows;
+}
+
+bool Emulator::is_caught_up()
+{
+    return frame().commands_done == commands_sent;
+}
+
+void Emulator::run()
+{
+    sf::Clock clock;
+    while (running)
+    {
+        Command command;
+        while (commands.pop(command))
+        {
+            apply(command);
+            commands_done++;
+        }
+        step(clock.restart());
+        if (beeper != nullptr)
+        {
+            for (const Chip8::SoundEdge& edge : sound_edges) beeper->push_edge(edge);
+            sound_edges.clear();
+            beeper->set_position(chip8.get_cycle_count(), chip8.get_clock_rate());
+        }
+        bool idle = publish();
+
+        bool uncapped = turbo && turbo_speeds[turbo_index] == 0 && !rewinding && !chip8.is_interrupted();
+        if (idle)
+        {
+            // nothing changes until a key arrives, and the time spent waiting must not be rewound frame by frame
+            sf::sleep(frame_t);
+            if (rewind_elapsed_t > frame_t) rewind_elapsed_t = frame_t;
+        }
+        else if (!uncapped)
+        {
+            sf::sleep(step_t);
+        }
+    }
+}
+
+void Emulator::apply(Command& command)
+{
+    switch (command.type)
+    {
+        case CommandType::PRESS_KEY:
+            movie.press_key(chip8, command.value);
+            break;
+        case CommandType::RELEASE_KEY:
+            movie.release_key(chip8, command.value);
+            break;
+        case CommandType::SAVE_STATE:
+            chip8.save_state(save_slot);
+            has_save = true;
+            break;
+        case CommandType::LOAD_STATE:
+            // loading a state would break the recording, so it is disabled while recording
+            if (has_save && !movie.is_recording()) chip8.load_state(save_slot);
+            break;
+        case CommandType::REWIND_HOLD:
+            rewinding = command.value != 0;
+            break;
+        case CommandType::TURBO:
+        case CommandType::TURBO_SPEED:
+            if (command.type == CommandType::TURBO) turbo = !turbo;
+            else turbo_index = (turbo_index + 1) % num_turbo_speeds;
+            if (turbo_speeds[turbo_index] == 0) std::cout << "Fast-forward " << (turbo ? "on" : "off") << ", uncapped" << std::endl;
+            else std::cout << "Fast-forward " << (turbo ? "on" : "off") << ", " << turbo_speeds[turbo_index] << "x" << std::endl;
+            break;
+        case CommandType::RECORD:
+            if (command.value != 0 && !movie.is_recording())
+            {
+                movie.start(chip8, rom);
+                rewind.clear();
+                std::cout << "Recording movie" << std::endl;
+            }
+            else if (command.value == 0 && movie.is_recording())
+            {
+                movie.stop();
+                std::cout << "Stopped recording, " << movie.size() << " events" << std::endl;
+            }
+            break;
+        case CommandType::SAVE_MOVIE:
+        {
+            std::ofstream file(command.path, std::ios::binary);
+            if (movie.save(file))
+            {
+                std::cout << "Saved movie to " << command.path << std::endl;
+            }
+            else
+            {
+                std::cout << "Error: could not write " << command.path << std::endl;
+            }
+            break;
+        }
+        case CommandType::MEM_DUMP:
+            chip8.mem_dump(std::cerr);
+            break;
+    }
+}
+
+void Emulator::step(sf::Time delta_t)
+{
+    // update chip 8, or step back through recorded frames while rewinding
+    bool rewind_now = rewinding && !movie.is_recording();
+    rewind_elapsed_t += delta_t;
+    if (!rewind_now && !turbo)
+    {
+        movie.update(chip8, delta_t);
+    }
+    else if (!rewind_now && turbo_speeds[turbo_index] > 0)
+    {
+        movie.update(chip8, delta_t * (float)turbo_speeds[turbo_index]);
+    }
+    else if (!rewind_now)
+    {
+        // timers follow emulated time, so they speed up with the instructions
+        sf::Clock turbo_clock;
+        do
+        {
+            movie.run_cycles(chip8, turbo_chunk);
+        } while (turbo_clock.getElapsedTime() < step_t && !chip8.is_interrupted());
+    }
+    for (; rewind_elapsed_t >= frame_t; rewind_elapsed_t -= frame_t)
+    {
+        if (!rewind_now)
+        {
+            chip8.save_state(rewind_state);
+            rewind.push(rewind_state);
+        }
+        else if (rewind.pop(rewind_state))
+        {
+            chip8.load_state(rewind_state);
+        }
+    }
+}
+
+bool Emulator::publish()
+{
+    Frame& frame = frames.back();
+    // the buffer still holds an older frame, copy the display only if it changed since then
+    if (frame.display_generation != chip8.get_display_generation())
+    {
+        frame.display = chip8.get_planes();
+        frame.display_generation = chip8.get_display_generation();
+    }
+    std::uint64_t rows = chip8.consume_dirty_rows();
+    frame.dirty_rows = rows | unseen_rows;
+    frame.hires = chip8.is_hires();
+    // while the sound timer runs, small steps keep the audio stream close behind emulation
+    frame.idle = (chip8.is_waiting_for_key() || chip8.is_interrupted()) && !chip8.get_sound() && !(rewinding && !movie.is_recording());
+    frame.commands_done = commands_done;
+    // after publish() back() is another buffer, so the flag is returned rather than read back
+    bool idle = frame.idle;
+    // rows of a frame the UI thread never took carry over into the next one
+    unseen_rows = frames.publish() ? rows : frame.dirty_rows;
+    return idle;
+}
@@ -0,0 +1,104 @@
+#ifndef EMULATOR
+#define EMULATOR
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <SFML/System.hpp>
+#include "chip8.h"
+#include "rewind.h"
+#include "movie.h"
+#include "beeper.h"
+#include "spsc_queue.h"
+#include "triple_buffer.h"
+
+/*
+Runs a Chip8 on its own thread.
+The UI thread sends commands (keys, save states, rewind, fast-forward, movie
+recording) through a lock-free queue, and the emulation thread publishes each
+finished frame through a lock-free triple buffer. Neither side ever waits for
+the other, so presenting at the display refresh rate never stalls emulation.
+Everything else in this class belongs to the emulation thread once start() is called.
+*/
+class Emulator
+{
+public:
+    struct Frame
+    {
+        Chip8Planes display{};
+        std::uint64_t display_generation = 0; // Chip8::get_display_generation() when display was copied
+        std::uint64_t dirty_rows = 0; // rows changed since the previous frame the UI thread took
+        bool hires = false;
+        bool idle = false; // waiting for a key or trapped and silent, so nothing changes until the next command
+        std::uint64_t commands_done = 0; // commands applied before this frame was emulated
+    };
+    enum class CommandType
+    {
+        PRESS_KEY, // value is the key
+        RELEASE_KEY,
+        SAVE_STATE,
+        LOAD_STATE,
+        REWIND_HOLD, // value 1 while Backspace is held, 0 when released
+        TURBO, // toggle fast-forward
+        TURBO_SPEED, // cycle through the fast-forward speeds
+        RECORD, // value 1 restarts the program and starts recording a movie, 0 stops
+        SAVE_MOVIE, // write the last recorded movie to path
+        MEM_DUMP
+    };
+    struct Command
+    {
+        CommandType type;
+        int value = 0;
+        std::string path;
+    };
+
+    // sound edges are streamed to beeper if given
+    Emulator(std::vector<std::uint8_t>& rom, Beeper* beeper = nullptr, Chip8::Variant variant = Chip8::Variant::SUPER_CHIP);
+    ~Emulator(); // stops and joins the emulation thread
+    void start();
+
+    // UI thread only
+    void send(const Command& command);
+    const Frame& frame(); // newest published frame
+    std::uint64_t consume_dirty_rows(); // rows changed in the frames taken by frame() since the last call
+    bool is_caught_up(); // true once the newest frame reflects every command sent
+
+private:
+    static const std::int64_t turbo_chunk = 1000; // instructions per run_cycles() call when uncapped
+
+    // emulation thread state
+    Chip8 chip8;
+    std::vector<std::uint8_t> rom;
+    Beeper* beeper;
+    std::vector<Chip8::SoundEdge> sound_edges; // logged by the machine during one step
+    Movie movie;
+    Chip8::State save_slot;
+    bool has_save;
+    Rewind rewind; // one frame recorded every 1/60 s
+    Chip8::State rewind_state;
+    sf::Time rewind_elapsed_t;
+    bool rewinding;
+    bool turbo;
+    int turbo_index;
+    std::uint64_t commands_done;
+    std::uint64_t unseen_rows; // rows changed in published frames the UI thread has not taken yet
+
+    // shared between the threads
+    SpscQueue<Command, 256> commands;
+    TripleBuffer<Frame> frames;
+    std::atomic<bool> running;
+    std::thread thread;
+
+    // UI thread state
+    std::uint64_t commands_sent;
+    std::uint64_t taken_rows; // dirty rows of the frames taken since consume_dirty_rows()
+
+    void run();
+    void apply(Command& command);
+    void step(sf::Time delta_t);
+    bool publish(); // returns whether the published frame is idle
+};
+
+#endif /* EMULATOR */
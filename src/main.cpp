@@ -8,8 +8,11 @@
 #include <SFML/Audio.hpp>
 #include <nfd.hpp>
 #include "chip8.h"
+#include "renderer.h"
+#include "emulator.h"
+#include "beeper.h"
 
-void handle_key_input(Chip8& chip8, sf::Event key_event)
+void handle_key_input(Emulator& emulator, sf::Event key_event)
 {
     int key;
     switch (key_event.key.code)
@@ -34,50 +37,38 @@ void handle_key_input(Chip8& chip8, sf::Event key_event)
     }
     if (key_event.type == sf::Event::KeyPressed)
     {
-        chip8.press_key(key);
+        emulator.send({Emulator::CommandType::PRESS_KEY, key});
     }
     else if (key_event.type == sf::Event::KeyReleased)
     {
-        chip8.release_key(key);
+        emulator.send({Emulator::CommandType::RELEASE_KEY, key});
     }
 }
 
 nfdresult_t request_file(NFD::UniquePath& outPath) {
     NFD::Guard nfdGuard;
-    nfdfilteritem_t filterItem[1] = {{"CHIP-8 program", "ch8"}};
+    nfdfilteritem_t filterItem[1] = {{"CHIP-8 program", "ch8,sc8,xo8"}};
     nfdresult_t result = NFD::OpenDialog(outPath, filterItem, 1);
     return result;
 }
 
+void save_movie(Emulator& emulator)
+{
+    NFD::Guard nfdGuard;
+    NFD::UniquePath outPath;
+    nfdfilteritem_t filterItem[1] = {{"CHIP-8 movie", "c8m"}};
+    if (NFD::SaveDialog(outPath, filterItem, 1, nullptr, "movie.c8m") != NFD_OKAY) return;
+    emulator.send({Emulator::CommandType::SAVE_MOVIE, 0, outPath.get()});
+}
+
 int main() 
 {   
-    // Initialize hardware
-    Chip8 chip8;
-    // Initialize display
-    sf::Color color_on = sf::Color::White;
+    // Initialize display, presenting once per display refresh
     sf::RenderWindow window(sf::VideoMode(640, 320), "CHIP-8 Intepreter by PPTGamer"); 
-    sf::RectangleShape rects[CHIP8_DISPLAY_HEIGHT][CHIP8_DISPLAY_WIDTH];
-    float size = 10;
-    for (int x = 0; x < CHIP8_DISPLAY_WIDTH; x++)
-    {
-        for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; y++)
-        {
-            rects[y][x].setPosition({x * size, y * size});
-            rects[y][x].setSize({size, size});
-            rects[y][x].setFillColor(sf::Color::Black);
-        }
-    }
-    // Initialize beeper
-    sf::SoundBuffer sound_buffer;
-    int num_samples = 44100; 
-    std::int16_t samples[num_samples];
-    //Fill samples with a pure A tone (440hrz)
-    for (int i = 0; i < num_samples ; i++) {
-        samples[i] = ( 5000 * sin(440.0f * (2.0f * 3.1415f) * i / 44100));
-    }
-    sound_buffer.loadFromSamples(samples, num_samples, 1, 44100);
-    sf::Sound beeper(sound_buffer);
-    beeper.setLoop(true);
+    window.setVerticalSyncEnabled(true);
+    Renderer renderer(sf::Color::White);
+    // Initialize beeper, fed by the emulation thread
+    Beeper beeper;
     
     // load chip8 ROM
     NFD::UniquePath outPath;
@@ -88,14 +79,26 @@ int main()
         std::ifstream file;
         file.open(outPath.get(), std::ios::binary);
         std::vector<std::uint8_t> bytes(std::istreambuf_iterator<char>(file), {});
-        chip8.load_program(bytes);
+        // XO-CHIP programs need the larger memory and extra instructions, everything else runs as SUPER-CHIP
+        std::string path = outPath.get();
+        bool xo_chip = path.size() >= 4 && path.compare(path.size() - 4, 4, ".xo8") == 0;
+
+        // the machine runs on its own thread, this loop only forwards input and presents frames
+        Emulator emulator(bytes, &beeper, xo_chip ? Chip8::Variant::XO_CHIP : Chip8::Variant::SUPER_CHIP);
+        emulator.start();
+        beeper.play();
+        bool rewind_held = false; // Backspace steps back through recorded frames while held
+        bool recording = false; // input movie (Ctrl+R restarts the program and starts recording, Ctrl+R again stops and saves)
 
         // start main loop
-        sf::Clock main_clock;
         while (window.isOpen()) 
         { 
             sf::Event event; 
-            while (window.pollEvent(event)) 
+            // While the program waits for a key in silence and the screen cannot change, sleep until an event arrives.
+            const Emulator::Frame& waiting = emulator.frame();
+            bool idle = waiting.idle && renderer.is_settled() && !rewind_held && emulator.is_caught_up();
+            bool has_event = idle ? window.waitEvent(event) : window.pollEvent(event);
+            for (; has_event; has_event = window.pollEvent(event))
             { 
                 if (event.type == sf::Event::Closed)
                 {
@@ -103,54 +106,46 @@ int main()
                 }
                 if (event.type == sf::Event::KeyPressed || event.type == sf::Event::KeyReleased)
                 {
-                    handle_key_input(chip8, event);
+                    handle_key_input(emulator, event);
                 }
                 if (event.type == sf::Event::KeyPressed && event.key.control && event.key.code == sf::Keyboard::Key::D)
                 {
-                    chip8.mem_dump(std::cerr);
+                    emulator.send({Emulator::CommandType::MEM_DUMP});
+                }
+                if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Key::F5)
+                {
+                    emulator.send({Emulator::CommandType::SAVE_STATE});
+                }
+                if (event.type == sf::Event::KeyPressed && event.key.control && event.key.code == sf::Keyboard::Key::R)
+                {
+                    recording = !recording;
+                    emulator.send({Emulator::CommandType::RECORD, recording});
+                    if (!recording) save_movie(emulator);
+                }
+                if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Key::Tab)
+                {
+                    emulator.send({event.key.shift ? Emulator::CommandType::TURBO_SPEED : Emulator::CommandType::TURBO});
+                }
+                if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Key::F9)
+                {
+                    emulator.send({Emulator::CommandType::LOAD_STATE});
+                }
+                // rewind follows Backspace, and stops when the window loses focus since the release would be missed
+                bool backspace = event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Key::BackSpace;
+                if (backspace != rewind_held && (backspace || event.type == sf::Event::LostFocus
+                    || (event.type == sf::Event::KeyReleased && event.key.code == sf::Keyboard::Key::BackSpace)))
+                {
+                    rewind_held = backspace;
+                    emulator.send({Emulator::CommandType::REWIND_HOLD, rewind_held});
                 }
             } 
-            // update chip 8
-            chip8.update(main_clock.restart());
             
-            // render
+            // render the newest finished frame
+            const Emulator::Frame& frame = emulator.frame();
             window.clear(); 
-            auto display = chip8.get_display();
-            bool sound_flag = chip8.get_sound();
-            for (int x = 0; x < CHIP8_DISPLAY_WIDTH; x++)
-            {
-                for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; y++)
-                {
-                    if (display[y][x])
-                    {
-                        rects[y][x].setFillColor(
-                            {
-                                (unsigned char)std::min(255, (int)(rects[y][x].getFillColor().r + 0.3 * color_on.r)),
-                                (unsigned char)std::min(255, (int)(rects[y][x].getFillColor().g + 0.3 * color_on.g)),
-                                (unsigned char)std::min(255, (int)(rects[y][x].getFillColor().b + 0.3 * color_on.b))
-                            });
-                    }
-                    else
-                    {
-                        rects[y][x].setFillColor(
-                            {
-                                (unsigned char)std::max(0, rects[y][x].getFillColor().r - 10),
-                                (unsigned char)std::max(0, rects[y][x].getFillColor().g - 10),
-                                (unsigned char)std::max(0, rects[y][x].getFillColor().b - 10)
-                            });
-                    }
-                    window.draw(rects[y][x]);
-                }
-            }
+            renderer.update(frame.display, frame.hires, emulator.consume_dirty_rows());
+            renderer.draw(window);
             window.display();
-            if (sound_flag)
-            {
-                beeper.play();
-            }
-            else
-            {
-                beeper.stop();
-            }
         } 
     }
     else if (nfd_result == NFD_CANCEL)
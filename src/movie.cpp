@@ -0,0 +1,209 @@
+#include <random>
+#include "movie.h"
+
+static void put_varint(std::ostream& out, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.put((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.put((char)value);
+}
+
+static bool get_varint(std::istream& in, std::uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= (std::uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+static void put_u64(std::ostream& out, std::uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        out.put((char)(value >> (8 * i)));
+    }
+}
+
+static bool get_u64(std::istream& in, std::uint64_t& value)
+{
+    value = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= (std::uint64_t)byte << (8 * i);
+    }
+    return true;
+}
+
+Movie::Movie() : recording(false), start_cycle(0), seed(0), clock_hz(0), variant(Chip8::Variant::SUPER_CHIP), rom_fnv(0)
+{
+
+}
+
+void Movie::reset(Chip8& chip8, std::uint64_t seed, std::int64_t clock_hz, Chip8::Variant variant, std::vector<std::uint8_t>& rom)
+{
+    chip8.set_variant(variant); // also resets the machine
+    chip8.seed(seed);
+    chip8.set_clock_rate(clock_hz);
+    chip8.load_program(rom);
+}
+
+void Movie::start(Chip8& chip8, std::vector<std::uint8_t>& rom)
+{
+    std::random_device random_device;
+    seed = ((std::uint64_t)random_device() << 32) | random_device();
+    clock_hz = chip8.get_clock_rate();
+    variant = chip8.get_variant();
+    rom_fnv = rom_hash(rom);
+    events.clear();
+    reset(chip8, seed, clock_hz, variant, rom);
+    start_cycle = chip8.get_cycle_count(); // not reset with the machine
+    recording = true;
+}
+
+void Movie::stop()
+{
+    recording = false;
+}
+
+bool Movie::is_recording()
+{
+    return recording;
+}
+
+std::size_t Movie::size()
+{
+    return events.size();
+}
+
+void Movie::record(Chip8& chip8, EventType type, std::int64_t value)
+{
+    if (recording) events.push_back({type, chip8.get_cycle_count() - start_cycle, chip8.get_instruction_count(), value});
+}
+
+void Movie::update(Chip8& chip8, sf::Time delta_t)
+{
+    record(chip8, UPDATE, delta_t.asMicroseconds());
+    chip8.update(delta_t);
+}
+
+void Movie::run_cycles(Chip8& chip8, std::int64_t cycles)
+{
+    record(chip8, CYCLES, cycles);
+    chip8.run_cycles(cycles);
+}
+
+void Movie::press_key(Chip8& chip8, int key)
+{
+    record(chip8, PRESS, key);
+    chip8.press_key(key);
+}
+
+void Movie::release_key(Chip8& chip8, int key)
+{
+    record(chip8, RELEASE, key);
+    chip8.release_key(key);
+}
+
+Movie::Result Movie::replay(Chip8& chip8, std::vector<std::uint8_t>& rom) const
+{
+    if (rom_hash(rom) != rom_fnv) return Result::ROM_MISMATCH;
+    reset(chip8, seed, clock_hz, variant, rom);
+    std::uint64_t first_cycle = chip8.get_cycle_count();
+    for (const Event& event : events)
+    {
+        if (chip8.get_cycle_count() - first_cycle != event.cycle || chip8.get_instruction_count() != event.instruction_count) return Result::DESYNC;
+        switch (event.type)
+        {
+            case UPDATE: chip8.update(sf::microseconds(event.value)); break;
+            case PRESS: chip8.press_key((int)event.value); break;
+            case RELEASE: chip8.release_key((int)event.value); break;
+            case CYCLES: chip8.run_cycles(event.value); break;
+        }
+    }
+    return Result::OK;
+}
+
+const char* Movie::result_name(Result result)
+{
+    switch (result)
+    {
+        case Result::OK: return "OK";
+        case Result::ROM_MISMATCH: return "ROM_MISMATCH";
+        case Result::DESYNC: return "DESYNC";
+    }
+    return "UNKNOWN";
+}
+
+bool Movie::save(std::ostream& out) const
+{
+    // header: magic and version as 32-bit words, seed and ROM hash as 64-bit words, little endian, then clock rate and variant
+    put_u64(out, ((std::uint64_t)VERSION << 32) | MAGIC);
+    put_u64(out, seed);
+    put_u64(out, rom_fnv);
+    put_varint(out, clock_hz);
+    put_varint(out, (std::uint64_t)variant);
+    put_varint(out, events.size());
+    // events: cycle as a delta from the previous event packed with the type, then the instruction count delta and the value
+    std::uint64_t last_cycle = 0;
+    std::uint64_t last_count = 0;
+    for (const Event& event : events)
+    {
+        put_varint(out, ((event.cycle - last_cycle) << 2) | event.type);
+        put_varint(out, event.instruction_count - last_count);
+        put_varint(out, event.value);
+        last_cycle = event.cycle;
+        last_count = event.instruction_count;
+    }
+    return (bool)out;
+}
+
+bool Movie::load(std::istream& in)
+{
+    std::uint64_t header, count, rate, new_variant;
+    if (!get_u64(in, header) || header != (((std::uint64_t)VERSION << 32) | MAGIC)) return false;
+    std::uint64_t new_seed, new_rom_fnv;
+    if (!get_u64(in, new_seed) || !get_u64(in, new_rom_fnv)) return false;
+    if (!get_varint(in, rate) || !get_varint(in, new_variant) || !get_varint(in, count)) return false;
+    if (new_variant > (std::uint64_t)Chip8::Variant::XO_CHIP) return false;
+    std::vector<Event> new_events;
+    std::uint64_t last_cycle = 0;
+    std::uint64_t last_count = 0;
+    for (std::uint64_t i = 0; i < count; i++)
+    {
+        std::uint64_t packed, instructions, value;
+        if (!get_varint(in, packed) || !get_varint(in, instructions) || !get_varint(in, value)) return false;
+        EventType type = (EventType)(packed & 3); // all four values are valid event types
+        last_cycle += packed >> 2;
+        last_count += instructions;
+        new_events.push_back({type, last_cycle, last_count, (std::int64_t)value});
+    }
+    recording = false;
+    seed = new_seed;
+    rom_fnv = new_rom_fnv;
+    clock_hz = (std::int64_t)rate;
+    variant = (Chip8::Variant)new_variant;
+    events.swap(new_events);
+    return true;
+}
+
+std::uint64_t Movie::rom_hash(const std::vector<std::uint8_t>& rom)
+{
+    // FNV-1a
+    std::uint64_t hash = 14695981039346656037ull;
+    for (std::uint8_t byte : rom)
+    {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
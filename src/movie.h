@@ -0,0 +1,76 @@
+#ifndef MOVIE
+#define MOVIE
+#include <cstdint>
+#include <vector>
+#include <iostream>
+#include <SFML/System.hpp>
+#include "chip8.h"
+
+/*
+Input movie: everything needed to replay a session exactly.
+The header holds the RNG seed, the clock rate, the variant and a hash of the ROM. Each
+update(), run_cycles() and key event is stored with the emulated cycle it happened at,
+counted from the start of the recording, so replay can feed the same calls back. The
+update() and run_cycles() calls are needed because they decide how many cycles pass.
+Each event also stores the instruction count at that point. The cycles follow from the
+calls alone, so only the instruction count shows that the program took another path.
+Events are varint encoded, a typical frame costs 4 or 5 bytes.
+*/
+class Movie
+{
+public:
+    static const std::uint32_t MAGIC = 0x564D3843; // "C8MV"
+    static const std::uint32_t VERSION = 4;
+    enum class Result
+    {
+        OK,
+        ROM_MISMATCH, // the movie was recorded with a different ROM
+        DESYNC // an event happened at a different cycle or instruction count than recorded
+    };
+
+    Movie();
+    // Reset the machine, load the ROM and start recording from power-on.
+    void start(Chip8& chip8, std::vector<std::uint8_t>& rom);
+    void stop();
+    bool is_recording();
+    // Forward to the machine, recording the call while a recording is running.
+    void update(Chip8& chip8, sf::Time delta_t);
+    void run_cycles(Chip8& chip8, std::int64_t cycles);
+    void press_key(Chip8& chip8, int key);
+    void release_key(Chip8& chip8, int key);
+    // Reset the machine and play every event back as fast as possible.
+    Result replay(Chip8& chip8, std::vector<std::uint8_t>& rom) const;
+    static const char* result_name(Result result);
+
+    bool save(std::ostream& out) const;
+    bool load(std::istream& in); // false if the stream is not a movie of this version
+    std::size_t size(); // number of recorded events
+    static std::uint64_t rom_hash(const std::vector<std::uint8_t>& rom);
+private:
+    enum EventType : std::uint8_t
+    {
+        UPDATE, // value is delta_t in microseconds
+        PRESS, // value is the key
+        RELEASE,
+        CYCLES // value is the number of instructions
+    };
+    struct Event
+    {
+        EventType type;
+        std::uint64_t cycle; // emulated cycles since the recording started
+        std::uint64_t instruction_count; // instructions executed since the machine was reset, checked on replay
+        std::int64_t value;
+    };
+    bool recording;
+    std::uint64_t start_cycle; // Chip8::get_cycle_count() when the recording started
+    std::uint64_t seed;
+    std::int64_t clock_hz;
+    Chip8::Variant variant;
+    std::uint64_t rom_fnv;
+    std::vector<Event> events;
+
+    void record(Chip8& chip8, EventType type, std::int64_t value);
+    static void reset(Chip8& chip8, std::uint64_t seed, std::int64_t clock_hz, Chip8::Variant variant, std::vector<std::uint8_t>& rom);
+};
+
+#endif /* MOVIE */
@@ -0,0 +1,30 @@
+#ifndef PCG32
+#define PCG32
+#include <cstdint>
+
+// PCG32 random number generator (pcg-random.org): 16 bytes of state, trivially copyable.
+class Pcg32
+{
+public:
+    std::uint64_t state;
+    std::uint64_t inc; // stream selector, always odd
+
+    void seed(std::uint64_t seed, std::uint64_t stream = 0xDA3E39CB94B95BDBull)
+    {
+        state = 0;
+        inc = (stream << 1) | 1;
+        next();
+        state += seed;
+        next();
+    }
+    std::uint32_t next()
+    {
+        std::uint64_t old_state = state;
+        state = old_state * 6364136223846793005ull + inc;
+        std::uint32_t xorshifted = (std::uint32_t)(((old_state >> 18) ^ old_state) >> 27);
+        std::uint32_t rot = (std::uint32_t)(old_state >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+};
+
+#endif /* PCG32 */
@@ -0,0 +1,114 @@
+#include "renderer.h"
+
+Renderer::Renderer(sf::Color color_on, sf::Color color_plane1, sf::Color color_both)
+{
+    palette[0] = sf::Color::Black;
+    palette[1] = color_on;
+    palette[2] = color_plane1;
+    palette[3] = color_both;
+    pixels.assign(CHIP8_HIRES_WIDTH * CHIP8_HIRES_HEIGHT * 4, 0);
+    for (std::size_t i = 3; i < pixels.size(); i += 4)
+    {
+        pixels[i] = 255;
+    }
+    texture.create(CHIP8_HIRES_WIDTH, CHIP8_HIRES_HEIGHT);
+    texture.setSmooth(false);
+    texture.update(pixels.data());
+    sprite.setTexture(texture, true);
+    sprite.setTextureRect(sf::IntRect(0, 0, CHIP8_DISPLAY_WIDTH, CHIP8_DISPLAY_HEIGHT));
+    shown = {};
+    settled.fill(~0ull); // every pixel starts out black, the colour of a blank display
+    hires = false;
+    fading_rows = 0;
+}
+
+void Renderer::update(const Chip8Planes& planes, bool hires, std::uint64_t dirty_rows)
+{
+    int width = hires ? CHIP8_HIRES_WIDTH : CHIP8_DISPLAY_WIDTH;
+    int height = hires ? CHIP8_HIRES_HEIGHT : CHIP8_DISPLAY_HEIGHT;
+    int row_words = width / 64;
+    if (hires != this->hires)
+    {
+        // pixels of the other resolution do not line up, start from black
+        for (std::size_t i = 0; i < pixels.size(); i++)
+        {
+            if (i % 4 != 3) pixels[i] = 0;
+        }
+        settled.fill(0);
+        this->hires = hires;
+        sprite.setTextureRect(sf::IntRect(0, 0, width, height));
+        dirty_rows = ~0ull;
+    }
+
+    // Pixels are composited 64 at a time: the planes give one mask per palette entry, and only the
+    // pixels that changed colour or are still fading are visited, by walking the set bits of those masks.
+    // Rows the machine did not change and that are not fading are skipped without being compared.
+    std::uint64_t visit = dirty_rows | fading_rows;
+    std::uint64_t rows = 0; // rows to upload
+    fading_rows = 0;
+    for (int y = 0; y < height; y++)
+    {
+        if (((visit >> y) & 1) == 0) continue;
+        for (int w = 0; w < row_words; w++)
+        {
+            int i = y * CHIP8_ROW_WORDS + w;
+            std::uint64_t p0 = planes[0][i];
+            std::uint64_t p1 = planes[1][i];
+            std::uint64_t todo = (p0 ^ shown[0][i]) | (p1 ^ shown[1][i]) | ~settled[i];
+            if (todo == 0) continue;
+            shown[0][i] = p0;
+            shown[1][i] = p1;
+            rows |= 1ull << y;
+            const std::uint64_t masks[4] = {~p0 & ~p1, p0 & ~p1, ~p0 & p1, p0 & p1};
+            for (int c = 0; c < 4; c++)
+            {
+                const sf::Uint8 target[3] = {palette[c].r, palette[c].g, palette[c].b};
+                for (std::uint64_t bits = todo & masks[c]; bits != 0; bits &= bits - 1)
+                {
+                    int bit = __builtin_ctzll(bits);
+                    std::uint64_t mask = 1ull << bit;
+                    sf::Uint8* pixel = &pixels[(y * CHIP8_HIRES_WIDTH + w * 64 + 63 - bit) * 4];
+                    bool done = true;
+                    for (int ch = 0; ch < 3; ch++)
+                    {
+                        int old_value = pixel[ch];
+                        // rise quickly towards a brighter colour, fade slowly towards a darker one
+                        if (old_value < target[ch]) pixel[ch] = (sf::Uint8)std::min<int>(target[ch], std::max<int>(old_value + 1, old_value + 0.3 * target[ch]));
+                        else if (old_value > target[ch]) pixel[ch] = (sf::Uint8)std::max<int>(target[ch], old_value - 10);
+                        done = done && pixel[ch] == target[ch];
+                    }
+                    if (done) settled[i] |= mask;
+                    else settled[i] &= ~mask;
+                }
+            }
+            if (settled[i] != ~0ull) fading_rows |= 1ull << y;
+        }
+    }
+    if (rows == 0) return;
+
+    // upload each run of consecutive updated rows
+    for (int y = 0; y < height;)
+    {
+        if (((rows >> y) & 1) == 0)
+        {
+            y++;
+            continue;
+        }
+        int first = y;
+        while (y < height && ((rows >> y) & 1)) y++;
+        texture.update(&pixels[first * CHIP8_HIRES_WIDTH * 4], CHIP8_HIRES_WIDTH, y - first, 0, first);
+    }
+}
+
+void Renderer::draw(sf::RenderTarget& target)
+{
+    sf::Vector2f size = target.getView().getSize();
+    sf::IntRect rect = sprite.getTextureRect();
+    sprite.setScale(size.x / rect.width, size.y / rect.height);
+    target.draw(sprite);
+}
+
+bool Renderer::is_settled()
+{
+    return fading_rows == 0;
+}
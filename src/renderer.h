@@ -0,0 +1,29 @@
+#ifndef RENDERER
+#define RENDERER
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "chip8.h"
+
+// Draws the CHIP-8 display as a single scaled texture, with a phosphor fade on each pixel.
+class Renderer
+{
+public:
+    // colours of pixels set in plane 0 only, plane 1 only (XO-CHIP) and both planes, the background is black
+    Renderer(sf::Color color_on = sf::Color::White, sf::Color color_plane1 = sf::Color(255, 102, 0), sf::Color color_both = sf::Color(102, 34, 0));
+    void update(const Chip8Planes& planes, bool hires, std::uint64_t dirty_rows); // advance the fade by one frame and upload the changed rows, bit y set if row y may have changed
+    void draw(sf::RenderTarget& target); // one draw call, scaled to fill the target
+    bool is_settled(); // true when no pixel is still fading, so frames stay identical until the display changes
+private:
+    sf::Color palette[4]; // indexed by the pixel's bit in plane 0 plus twice its bit in plane 1
+    std::vector<sf::Uint8> pixels; // RGBA, CHIP8_HIRES_WIDTH x CHIP8_HIRES_HEIGHT, low resolution uses the top-left corner
+    sf::Texture texture;
+    sf::Sprite sprite;
+    Chip8Planes shown; // planes as of the last update
+    Chip8Display settled; // bit set for each pixel that has reached its palette colour, same layout as the planes
+    bool hires;
+    std::uint64_t fading_rows; // rows with pixels that have not yet reached their final color
+};
+
+#endif /* RENDERER */
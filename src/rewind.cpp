@@ -0,0 +1,164 @@
+#include "rewind.h"
+
+static void put_varint(std::vector<std::uint8_t>& out, std::size_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((std::uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((std::uint8_t)value);
+}
+
+static std::size_t get_varint(const std::uint8_t*& p)
+{
+    std::size_t value = 0;
+    for (int shift = 0;; shift += 7)
+    {
+        std::uint8_t byte = *p++;
+        value |= (std::size_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return value;
+    }
+}
+
+Rewind::Rewind(std::size_t capacity, int keyframe_interval) : keyframe_interval(keyframe_interval)
+{
+    frames.resize(std::max<std::size_t>(capacity, 1));
+    clear();
+}
+
+void Rewind::clear()
+{
+    first = 0;
+    count = 0;
+    since_keyframe = 0;
+}
+
+std::size_t Rewind::size()
+{
+    return count;
+}
+
+Rewind::Frame& Rewind::at(std::size_t i)
+{
+    return frames[(first + i) % frames.size()];
+}
+
+void Rewind::drop_oldest()
+{
+    // a delta is useless without the keyframe before it, so drop whole keyframe groups
+    do
+    {
+        first = (first + 1) % frames.size();
+        count--;
+    } while (count > 0 && !at(0).keyframe);
+}
+
+void Rewind::push(const Chip8::State& state)
+{
+    if (count == frames.size()) drop_oldest();
+    bool keyframe = (count == 0 || since_keyframe >= keyframe_interval);
+    Frame& frame = at(count);
+    frame.keyframe = keyframe;
+    frame.data.clear();
+    const std::uint8_t* curr = (const std::uint8_t*)&state;
+    if (keyframe)
+    {
+        frame.data.assign(curr, curr + sizeof state);
+        since_keyframe = 0;
+    }
+    else
+    {
+        encode_delta((const std::uint8_t*)&newest, curr, sizeof state, frame.data);
+    }
+    since_keyframe++;
+    count++;
+    memcpy(&newest, &state, sizeof state);
+}
+
+bool Rewind::pop(Chip8::State& out)
+{
+    if (count == 0) return false;
+    memcpy(&out, &newest, sizeof out);
+    Frame& popped = at(count - 1);
+    count--;
+    if (count == 0)
+    {
+        since_keyframe = 0;
+        return true;
+    }
+    std::uint8_t* state = (std::uint8_t*)&newest;
+    if (!popped.keyframe)
+    {
+        // XOR deltas undo themselves
+        apply_delta(popped.data, state);
+        since_keyframe--;
+        return true;
+    }
+    // Stepping back over a keyframe: rebuild the new newest frame from the keyframe before it.
+    std::size_t key = count - 1;
+    while (!at(key).keyframe) key--;
+    memcpy(state, at(key).data.data(), sizeof newest);
+    for (std::size_t i = key + 1; i < count; i++)
+    {
+        apply_delta(at(i).data, state);
+    }
+    since_keyframe = (int)(count - key);
+    return true;
+}
+
+// Delta format: repeated (zero run length, literal length, literal bytes), lengths as varints.
+void Rewind::encode_delta(const std::uint8_t* prev, const std::uint8_t* curr, std::size_t size, std::vector<std::uint8_t>& out)
+{
+    std::size_t i = 0;
+    while (i < size)
+    {
+        std::size_t zero_start = i;
+        // skip unchanged bytes a word at a time where possible
+        while (i + 8 <= size)
+        {
+            std::uint64_t a, b;
+            memcpy(&a, prev + i, 8);
+            memcpy(&b, curr + i, 8);
+            if (a != b) break;
+            i += 8;
+        }
+        while (i < size && prev[i] == curr[i]) i++;
+        if (i == size) break;
+        std::size_t zeros = i - zero_start;
+
+        // literal run ends at the next stretch of 4 unchanged bytes
+        std::size_t literal_start = i;
+        std::size_t same = 0;
+        while (i < size && same < 4)
+        {
+            same = (prev[i] == curr[i]) ? same + 1 : 0;
+            i++;
+        }
+        std::size_t literal_end = i - same;
+        i = literal_end;
+
+        put_varint(out, zeros);
+        put_varint(out, literal_end - literal_start);
+        for (std::size_t j = literal_start; j < literal_end; j++)
+        {
+            out.push_back(prev[j] ^ curr[j]);
+        }
+    }
+}
+
+void Rewind::apply_delta(const std::vector<std::uint8_t>& delta, std::uint8_t* state)
+{
+    const std::uint8_t* p = delta.data();
+    const std::uint8_t* end = p + delta.size();
+    std::size_t i = 0;
+    while (p < end)
+    {
+        i += get_varint(p);
+        std::size_t literal = get_varint(p);
+        for (std::size_t j = 0; j < literal; j++)
+        {
+            state[i++] ^= *p++;
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef REWIND
+#define REWIND
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "chip8.h"
+
+/*
+Ring of past machine states for frame-by-frame rewind.
+Every keyframe_interval frames a full Chip8::State is stored, the frames in
+between store the XOR against the previous frame, run-length encoded so that
+unchanged bytes cost almost nothing. The ring holds a fixed number of frames
+and reuses its buffers once it has filled up.
+*/
+class Rewind
+{
+public:
+    Rewind(std::size_t capacity = 600, int keyframe_interval = 60);
+    void push(const Chip8::State& state); // record the newest frame
+    bool pop(Chip8::State& out); // remove the newest frame and return it, false when empty
+    void clear();
+    std::size_t size();
+private:
+    struct Frame
+    {
+        bool keyframe;
+        std::vector<std::uint8_t> data; // full state for keyframes, encoded XOR delta otherwise
+    };
+    std::vector<Frame> frames;
+    std::size_t first; // index of the oldest frame
+    std::size_t count;
+    int keyframe_interval;
+    int since_keyframe; // frames pushed since the last keyframe
+    Chip8::State newest; // decoded copy of the newest frame
+
+    Frame& at(std::size_t i); // i-th frame from the oldest
+    void drop_oldest();
+    static void encode_delta(const std::uint8_t* prev, const std::uint8_t* curr, std::size_t size, std::vector<std::uint8_t>& out);
+    static void apply_delta(const std::vector<std::uint8_t>& delta, std::uint8_t* state);
+};
+
+#endif /* REWIND */
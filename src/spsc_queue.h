@@ -0,0 +1,42 @@
+#ifndef SPSC_QUEUE
+#define SPSC_QUEUE
+#include <cstddef>
+#include <atomic>
+
+/*
+Bounded single-producer single-consumer queue.
+One thread may push and one other thread may pop, neither ever blocks or
+takes a lock. Capacity must be a power of two.
+*/
+template <typename T, std::size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+public:
+    bool push(const T& item) // producer only, false when full
+    {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+        items[t & (Capacity - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop(T& item) // consumer only, false when empty
+    {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        item = std::move(items[h & (Capacity - 1)]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    std::size_t size() const // approximate when called while the other side is active
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+private:
+    T items[Capacity];
+    alignas(64) std::atomic<std::size_t> head{0}; // next item to pop, written by the consumer
+    alignas(64) std::atomic<std::size_t> tail{0}; // next free slot, written by the producer
+};
+
+#endif /* SPSC_QUEUE */
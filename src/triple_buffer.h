@@ -0,0 +1,46 @@
+#ifndef TRIPLE_BUFFER
+#define TRIPLE_BUFFER
+#include <cstdint>
+#include <atomic>
+
+/*
+Lock-free handoff of the newest value from one producer thread to one consumer thread.
+The producer fills back() and publishes it, the consumer calls update() and
+reads front(). Neither side waits: the producer always has a buffer to write,
+and values the consumer did not get to in time are overwritten.
+*/
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : back_index(0), middle(1), front_index(2) {}
+    T& back() // producer only
+    {
+        return buffers[back_index];
+    }
+    bool publish() // producer only, makes back() the newest value, false if it replaced one the consumer never got
+    {
+        std::uint8_t old_middle = middle.exchange(back_index | fresh, std::memory_order_acq_rel);
+        back_index = old_middle & index_mask;
+        return (old_middle & fresh) == 0;
+    }
+    bool update() // consumer only, switches front() to the newest value, false if nothing new was published
+    {
+        if ((middle.load(std::memory_order_relaxed) & fresh) == 0) return false;
+        front_index = middle.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+    const T& front() const // consumer only
+    {
+        return buffers[front_index];
+    }
+private:
+    static const std::uint8_t index_mask = 3;
+    static const std::uint8_t fresh = 4; // set in middle when it holds a value the consumer has not seen
+    T buffers[3];
+    std::uint8_t back_index;
+    alignas(64) std::atomic<std::uint8_t> middle;
+    alignas(64) std::uint8_t front_index;
+};
+
+#endif /* TRIPLE_BUFFER */
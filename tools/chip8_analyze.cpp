@@ -0,0 +1,220 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include "chip8.h"
+#include "chip8_analysis.h"
+
+// Static ROM analyzer: one CSV line of control-flow and code/data statistics per ROM, or a commented listing.
+
+struct Options
+{
+    bool xo_chip = false; // analyze every ROM as XO-CHIP, otherwise only those named *.xo8
+    bool listing = false;
+};
+
+bool is_xo_chip(const std::string& path)
+{
+    return path.size() >= 4 && path.compare(path.size() - 4, 4, ".xo8") == 0;
+}
+
+std::string hex(int value, int digits)
+{
+    char text[16];
+    snprintf(text, sizeof text, "0x%0*X", digits, value);
+    return text;
+}
+
+const char* exit_name(Chip8Analysis::Exit exit)
+{
+    switch (exit)
+    {
+        case Chip8Analysis::Exit::FALLTHROUGH: return "fallthrough";
+        case Chip8Analysis::Exit::JUMP: return "jump";
+        case Chip8Analysis::Exit::CALL: return "call";
+        case Chip8Analysis::Exit::RETURN: return "return";
+        case Chip8Analysis::Exit::SKIP: return "skip";
+        case Chip8Analysis::Exit::INDIRECT: return "indirect";
+        case Chip8Analysis::Exit::STOP: return "stop";
+    }
+    return "";
+}
+
+const char* use_name(std::uint8_t use)
+{
+    if (use & Chip8Analysis::BYTE_WRITTEN) return (use & Chip8Analysis::BYTE_READ) ? "read, written" : "written";
+    if (use & Chip8Analysis::BYTE_READ) return "read";
+    return "unknown";
+}
+
+void print_listing(std::ostream& out, const std::string& path, const Chip8Analysis& analysis)
+{
+    int digits = analysis.get_load_address() + analysis.get_rom_size() > 0x1000 ? 4 : 3;
+    std::vector<const Chip8Analysis::Store*> store_at(analysis.get_load_address() + analysis.get_rom_size() + 4, nullptr);
+    for (const Chip8Analysis::Store& store : analysis.get_stores())
+    {
+        if (store.pc < store_at.size()) store_at[store.pc] = &store;
+    }
+
+    out << "; " << path << std::endl;
+    for (const Chip8Analysis::Subroutine& sub : analysis.get_subroutines())
+    {
+        out << "; subroutine " << hex(sub.entry, digits) << (sub.returns ? "" : " (does not return)") << ", calls";
+        for (std::uint16_t callee : sub.callees) out << " " << hex(callee, digits);
+        if (sub.callees.empty()) out << " nothing";
+        out << std::endl;
+    }
+    int depth = analysis.max_call_depth();
+    out << "; max call depth " << (depth < 0 ? std::string("unbounded (recursion)") : std::to_string(depth)) << std::endl;
+
+    int end = analysis.get_load_address() + analysis.get_rom_size();
+    int addr = analysis.get_load_address();
+    while (addr < end)
+    {
+        if (analysis.is_instruction(addr))
+        {
+            const Chip8Analysis::Block* block = analysis.block_at(addr);
+            if (block != nullptr)
+            {
+                out << std::endl << hex(addr, digits) << ": ; " << block->length << " instructions, " << exit_name(block->exit);
+                if (block->exit == Chip8Analysis::Exit::CALL) out << " " << hex(block->callee, digits);
+                for (int s : block->successors) out << " -> " << hex(s, digits);
+                out << std::endl;
+            }
+            int length = analysis.instruction_length(addr);
+            out << "    " << hex(addr, digits) << "  ";
+            char raw[16];
+            snprintf(raw, sizeof raw, length == 4 ? "%02X%02X%02X%02X" : "%02X%02X    ",
+                static_cast<unsigned>(analysis.get_byte(addr)), static_cast<unsigned>(analysis.get_byte(addr + 1)),
+                static_cast<unsigned>(analysis.get_byte(addr + 2)), static_cast<unsigned>(analysis.get_byte(addr + 3)));
+            out << raw << "  " << analysis.disassemble(addr);
+            const Chip8Analysis::Store* store = addr < static_cast<int>(store_at.size()) ? store_at[addr] : nullptr;
+            if (store != nullptr && store->self_modifying) out << "  ; self-modifying, writes " << hex(store->addr, digits);
+            else if (store != nullptr && store->addr < 0) out << "  ; writes an address not known statically";
+            const std::vector<std::uint16_t>& indirect = analysis.get_indirect_jumps();
+            if (std::binary_search(indirect.begin(), indirect.end(), addr)) out << "  ; indirect jump";
+            out << std::endl;
+            addr += length;
+            continue;
+        }
+        // data: up to 8 bytes per line, split where the use changes
+        std::uint8_t use = analysis.byte_use(addr);
+        out << "    " << hex(addr, digits) << "  .byte";
+        int count = 0;
+        while (addr < end && count < 8 && !analysis.is_instruction(addr) && analysis.byte_use(addr) == use)
+        {
+            out << (count == 0 ? " " : ", ") << hex(analysis.get_byte(addr), 2);
+            addr++;
+            count++;
+        }
+        out << "  ; " << use_name(use) << std::endl;
+    }
+    out << std::endl;
+}
+
+void usage()
+{
+    std::cerr << "usage: chip8_analyze [--xo-chip] [--listing] [--list FILE] [--out FILE] ROM..." << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::string out_path;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--xo-chip") options.xo_chip = true;
+        else if (arg == "--listing") options.listing = true;
+        else if (arg == "--out" && has_value) out_path = argv[++i];
+        else if (arg == "--list" && has_value)
+        {
+            std::ifstream list(argv[++i]);
+            std::string line;
+            while (std::getline(list, line))
+            {
+                if (!line.empty()) paths.push_back(line);
+            }
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else paths.push_back(arg);
+    }
+    if (paths.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    std::ofstream out_file;
+    if (!out_path.empty()) out_file.open(out_path);
+    std::ostream& out = out_path.empty() ? std::cout : out_file;
+    if (!options.listing)
+    {
+        out << "rom,rom_bytes,code_bytes,data_bytes,unknown_bytes,blocks,subroutines,max_call_depth,"
+            << "indirect_jumps,stores,self_modifying_stores,unknown_stores" << std::endl;
+    }
+    Chip8Analysis chip8_analysis(Chip8::Variant::SUPER_CHIP);
+    Chip8Analysis xo_chip_analysis(Chip8::Variant::XO_CHIP);
+    int failed = 0;
+    double total_ms = 0;
+    for (std::string& path : paths)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            if (!options.listing) out << path << ",LOAD_FAILED,,,,,,,,,," << std::endl;
+            else std::cerr << "chip8_analyze: cannot read " << path << std::endl;
+            failed++;
+            continue;
+        }
+        std::vector<std::uint8_t> bytes(std::istreambuf_iterator<char>(file), {});
+        Chip8Analysis& analysis = options.xo_chip || is_xo_chip(path) ? xo_chip_analysis : chip8_analysis;
+        auto start = std::chrono::steady_clock::now();
+        analysis.analyze(bytes);
+        auto end = std::chrono::steady_clock::now();
+        total_ms += std::chrono::duration<double, std::milli>(end - start).count();
+
+        if (options.listing)
+        {
+            print_listing(out, path, analysis);
+            continue;
+        }
+        int code = 0, data = 0, unknown = 0;
+        for (int addr = analysis.get_load_address(); addr < analysis.get_load_address() + analysis.get_rom_size(); addr++)
+        {
+            std::uint8_t use = analysis.byte_use(addr);
+            if (use & Chip8Analysis::BYTE_CODE) code++;
+            else if (use != 0) data++;
+            else unknown++;
+        }
+        int self_modifying = 0, unknown_stores = 0;
+        for (const Chip8Analysis::Store& store : analysis.get_stores())
+        {
+            if (store.self_modifying) self_modifying++;
+            if (store.addr < 0) unknown_stores++;
+        }
+        out << path << ","
+            << analysis.get_rom_size() << ","
+            << code << ","
+            << data << ","
+            << unknown << ","
+            << analysis.get_blocks().size() << ","
+            << analysis.get_subroutines().size() << ","
+            << analysis.max_call_depth() << ","
+            << analysis.get_indirect_jumps().size() << ","
+            << analysis.get_stores().size() << ","
+            << self_modifying << ","
+            << unknown_stores << std::endl;
+    }
+    std::cerr << "chip8_analyze: " << paths.size() - failed << " ROMs analyzed in " << total_ms << " ms" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
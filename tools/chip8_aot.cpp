@@ -0,0 +1,343 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include "chip8.h"
+#include "chip8_analysis.h"
+
+// Ahead-of-time recompiler: writes a C++ file with one function per basic block of a ROM, for Chip8Aot.
+
+static const int max_block_length = 32; // longer blocks are split, a block only runs if the cycle budget covers all of it
+
+struct Instruction
+{
+    std::uint16_t raw;
+    int opcode() const {return raw >> 12;}
+    int X() const {return (raw >> 8) & 0xF;}
+    int Y() const {return (raw >> 4) & 0xF;}
+    int N() const {return raw & 0xF;}
+    int NN() const {return raw & 0xFF;}
+    int NNN() const {return raw & 0xFFF;}
+};
+
+std::string format(const char* pattern, int a = 0, int b = 0, int c = 0)
+{
+    char text[128];
+    snprintf(text, sizeof text, pattern, a, b, c);
+    return text;
+}
+
+class Generator
+{
+public:
+    Generator(const Chip8Analysis& analysis, bool xo_chip) : analysis(analysis), xo_chip(xo_chip)
+    {
+        digits = xo_chip ? 4 : 3;
+    }
+    // Registers and I are updated natively, everything else goes through the interpreter.
+    // The statements follow the interpreter's handlers, so VF ends up the same when X or Y is F.
+    bool native_body(int pc, std::string& code) const
+    {
+        Instruction ins = fetch(pc);
+        int x = ins.X(), y = ins.Y();
+        switch (ins.opcode())
+        {
+            case 0x6: code = format("V[0x%X] = 0x%02X;", x, ins.NN()); return true;
+            case 0x7: code = format("V[0x%X] += 0x%02X;", x, ins.NN()); return true;
+            case 0x8:
+                switch (ins.N())
+                {
+                    case 0x0: code = format("V[0x%X] = V[0x%X];", x, y); return true;
+                    case 0x1: code = format("V[0x%X] |= V[0x%X];", x, y); return true;
+                    case 0x2: code = format("V[0x%X] &= V[0x%X];", x, y); return true;
+                    case 0x3: code = format("V[0x%X] ^= V[0x%X];", x, y); return true;
+                    case 0x4: code = format("V[0xF] = V[0x%X] + V[0x%X] > 255; ", x, y) + format("V[0x%X] += V[0x%X];", x, y); return true;
+                    case 0x5: code = format("V[0xF] = V[0x%X] > V[0x%X]; ", x, y) + format("V[0x%X] = V[0x%X] - V[0x%X];", x, x, y); return true;
+                    case 0x6: code = format("V[0xF] = V[0x%X] & 1; ", x) + format("V[0x%X] = V[0x%X] >> 1;", x, x); return true;
+                    case 0x7: code = format("V[0xF] = V[0x%X] > V[0x%X]; ", y, x) + format("V[0x%X] = V[0x%X] - V[0x%X];", x, y, x); return true;
+                    case 0xE: code = format("V[0xF] = V[0x%X] >> 7; ", x) + format("V[0x%X] = V[0x%X] << 1;", x, x); return true;
+                }
+                return false;
+            case 0xA: code = format("m.I = 0x%03X;", ins.NNN()); return true;
+            case 0xF:
+                if (ins.NN() == 0x1E) {code = format("m.I += V[0x%X];", x); return true;}
+                if (ins.NN() == 0x07) {code = format("V[0x%X] = m.timer_delay;", x); return true;}
+                if (ins.raw == 0xF000 && xo_chip)
+                {
+                    code = format("m.I = 0x%04X;", (analysis.get_byte(pc + 2) << 8) | analysis.get_byte(pc + 3));
+                    return true;
+                }
+                return false;
+        }
+        return false;
+    }
+
+    std::string skip_condition(int pc) const
+    {
+        Instruction ins = fetch(pc);
+        int x = ins.X(), y = ins.Y();
+        switch (ins.opcode())
+        {
+            case 0x3: return format("V[0x%X] == 0x%02X", x, ins.NN());
+            case 0x4: return format("V[0x%X] != 0x%02X", x, ins.NN());
+            case 0x5: return format("V[0x%X] == V[0x%X]", x, y);
+            case 0x9: return format("V[0x%X] != V[0x%X]", x, y);
+            case 0xE: return format(ins.NN() == 0x9E ? "m.keys[V[0x%X] & 0xF]" : "!m.keys[V[0x%X] & 0xF]", x);
+        }
+        return "false";
+    }
+
+    // Splits a block into functions of at most max_block_length instructions and writes them.
+    void block(std::ostream& out, const Chip8Analysis::Block& block)
+    {
+        std::vector<int> pcs;
+        for (int pc = block.start; pc < block.end; pc += analysis.instruction_length(pc)) pcs.push_back(pc);
+        for (std::size_t first = 0; first < pcs.size(); first += max_block_length)
+        {
+            std::size_t last = std::min(pcs.size(), first + max_block_length) - 1;
+            bool terminator = last == pcs.size() - 1;
+            chunk(out, block, pcs, first, last, terminator);
+        }
+    }
+
+    void chunk(std::ostream& out, const Chip8Analysis::Block& block, const std::vector<int>& pcs, std::size_t first, std::size_t last, bool terminator)
+    {
+        using Exit = Chip8Analysis::Exit;
+        Entry entry;
+        entry.start = pcs[first];
+        entry.end = pcs[last] + analysis.instruction_length(pcs[last]);
+        entry.length = last - first + 1;
+        entry.jump = 0;
+        entry.function = "block_" + hex(entry.start, digits).substr(2);
+
+        std::ostringstream body;
+        int count = 0;
+        for (std::size_t i = first; i <= last; i++)
+        {
+            int pc = pcs[i];
+            count++;
+            std::string comment = " // " + hex(pc, digits) + ": " + analysis.disassemble(pc);
+            Exit exit = terminator && i == last ? block.exit : Exit::FALLTHROUGH;
+            std::string code;
+            if (exit == Exit::FALLTHROUGH && native_body(pc, code))
+            {
+                body << "    " << code << comment << std::endl;
+                if (i == last)
+                {
+                    body << "    m.current_PC = " << hex(pc, digits) << ";" << std::endl;
+                    body << "    m.PC = " << hex(entry.end, digits) << ";" << std::endl;
+                    body << "    return " << count << ";" << std::endl;
+                }
+                continue;
+            }
+            Instruction ins = fetch(pc);
+            int next = pc + 2;
+            switch (exit)
+            {
+                case Exit::FALLTHROUGH:
+                    if (i == last) body << "    m.interpret(" << hex(pc, digits) << ");" << comment << std::endl << "    return " << count << ";" << std::endl;
+                    else body << "    if (m.interpret(" << hex(pc, digits) << ")) return " << count << ";" << comment << std::endl;
+                    break;
+                case Exit::JUMP:
+                    entry.jump = pc;
+                    body << "    m.current_PC = " << hex(pc, digits) << ";" << comment << std::endl;
+                    body << "    m.PC = " << hex(ins.NNN(), 3) << ";" << std::endl;
+                    body << "    return " << count << ";" << std::endl;
+                    break;
+                case Exit::CALL:
+                    body << "    if (m.stack_size == Chip8::stack_depth)" << comment << std::endl;
+                    body << "    {" << std::endl;
+                    body << "        m.interpret(" << hex(pc, digits) << "); // overflows" << std::endl;
+                    body << "        return " << count << ";" << std::endl;
+                    body << "    }" << std::endl;
+                    body << "    m.current_PC = " << hex(pc, digits) << ";" << std::endl;
+                    body << "    m.stack[m.stack_size++] = " << hex(next, digits) << ";" << std::endl;
+                    body << "    m.PC = " << hex(ins.NNN(), 3) << ";" << std::endl;
+                    body << "    return " << count << ";" << std::endl;
+                    break;
+                case Exit::RETURN:
+                    body << "    if (m.stack_size == 0)" << comment << std::endl;
+                    body << "    {" << std::endl;
+                    body << "        m.interpret(" << hex(pc, digits) << "); // underflows" << std::endl;
+                    body << "        return " << count << ";" << std::endl;
+                    body << "    }" << std::endl;
+                    body << "    m.current_PC = " << hex(pc, digits) << ";" << std::endl;
+                    body << "    m.PC = m.stack[--m.stack_size];" << std::endl;
+                    body << "    return " << count << ";" << std::endl;
+                    break;
+                case Exit::SKIP:
+                {
+                    // an XO-CHIP skip steps over all of F000 NNNN, so the compiled target depends on the next word
+                    bool long_load = xo_chip && analysis.get_byte(next) == 0xF0 && analysis.get_byte(next + 1) == 0x00;
+                    entry.end = std::max(entry.end, xo_chip ? next + 2 : 0);
+                    body << "    m.current_PC = " << hex(pc, digits) << ";" << comment << std::endl;
+                    body << "    m.PC = " << skip_condition(pc) << " ? " << hex(next + (long_load ? 4 : 2), digits) << " : " << hex(next, digits) << ";" << std::endl;
+                    body << "    return " << count << ";" << std::endl;
+                    break;
+                }
+                case Exit::INDIRECT:
+                case Exit::STOP:
+                    body << "    m.interpret(" << hex(pc, digits) << ");" << comment << std::endl;
+                    body << "    return " << count << ";" << std::endl;
+                    break;
+            }
+        }
+
+        // blocks the ROM writes into with a known address are left to the interpreter
+        for (int addr = entry.start; addr < entry.end; addr++)
+        {
+            if (analysis.byte_use(addr) & Chip8Analysis::BYTE_WRITTEN)
+            {
+                out << "// " << hex(entry.start, digits) << ": not compiled, the ROM writes to " << hex(addr, digits) << std::endl << std::endl;
+                return;
+            }
+        }
+        std::string text = body.str();
+        out << "int " << entry.function << "(Chip8Aot& m)" << std::endl;
+        out << "{" << std::endl;
+        if (text.find("V[") != std::string::npos) out << "    std::uint8_t* V = m.V;" << std::endl;
+        out << text;
+        out << "}" << std::endl << std::endl;
+        entries.push_back(entry);
+    }
+
+    void table(std::ostream& out)
+    {
+        if (entries.empty())
+        {
+            out << "const Chip8Aot::Block* blocks = nullptr;" << std::endl;
+            out << "const int num_blocks = 0;" << std::endl;
+            return;
+        }
+        out << "const Chip8Aot::Block blocks[] =" << std::endl << "{" << std::endl;
+        for (const Entry& entry : entries)
+        {
+            out << "    {" << hex(entry.start, digits) << ", " << hex(entry.end, digits) << ", " << entry.length << ", "
+                << (entry.jump == 0 ? std::string("0") : hex(entry.jump, digits)) << ", " << entry.function << "}," << std::endl;
+        }
+        out << "};" << std::endl;
+        out << "const int num_blocks = sizeof blocks / sizeof blocks[0];" << std::endl;
+    }
+
+    std::size_t size() const {return entries.size();}
+
+    static std::string hex(int value, int digits)
+    {
+        return format("0x%0*X", digits, value);
+    }
+private:
+    struct Entry
+    {
+        int start;
+        int end;
+        int length;
+        int jump;
+        std::string function;
+    };
+    const Chip8Analysis& analysis;
+    bool xo_chip;
+    int digits;
+    std::vector<Entry> entries;
+
+    Instruction fetch(int pc) const
+    {
+        return {static_cast<std::uint16_t>((analysis.get_byte(pc) << 8) | analysis.get_byte(pc + 1))};
+    }
+};
+
+bool is_xo_chip(const std::string& path)
+{
+    return path.size() >= 4 && path.compare(path.size() - 4, 4, ".xo8") == 0;
+}
+
+std::string base_name(const std::string& path)
+{
+    // also used in a string literal and a comment of the generated file
+    std::size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    for (char& c : name)
+    {
+        if (c == '"' || c == '\\' || c < 0x20) c = '_';
+    }
+    return name;
+}
+
+void usage()
+{
+    std::cerr << "usage: chip8_aot [--xo-chip] [--out FILE] ROM" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    bool xo_chip = false;
+    std::string out_path;
+    std::string rom_path;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--xo-chip") xo_chip = true;
+        else if (arg == "--out" && has_value) out_path = argv[++i];
+        else if ((arg.size() > 1 && arg[0] == '-') || !rom_path.empty())
+        {
+            usage();
+            return 1;
+        }
+        else rom_path = arg;
+    }
+    if (rom_path.empty())
+    {
+        usage();
+        return 1;
+    }
+    std::ifstream file(rom_path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "chip8_aot: cannot read " << rom_path << std::endl;
+        return 1;
+    }
+    std::vector<std::uint8_t> bytes(std::istreambuf_iterator<char>(file), {});
+    xo_chip = xo_chip || is_xo_chip(rom_path);
+    Chip8::Variant variant = xo_chip ? Chip8::Variant::XO_CHIP : Chip8::Variant::SUPER_CHIP;
+    Chip8Analysis analysis(variant);
+    analysis.analyze(bytes);
+    if (bytes.empty() || analysis.get_rom_size() != static_cast<int>(bytes.size()))
+    {
+        std::cerr << "chip8_aot: " << rom_path << " is empty or does not fit in memory" << std::endl;
+        return 1;
+    }
+
+    std::ostringstream functions;
+    Generator generator(analysis, xo_chip);
+    for (const Chip8Analysis::Block& block : analysis.get_blocks()) generator.block(functions, block);
+
+    std::ofstream out_file;
+    if (!out_path.empty()) out_file.open(out_path);
+    std::ostream& out = out_path.empty() ? std::cout : out_file;
+    std::string name = base_name(rom_path);
+    out << "// Generated by chip8_aot from " << name << ", do not edit." << std::endl;
+    out << "// Linked into a build with AOT=1, this code runs whenever the same ROM is loaded." << std::endl;
+    out << "#include \"chip8_aot.h\"" << std::endl;
+    out << "#ifdef CHIP8_AOT" << std::endl << std::endl;
+    out << "namespace" << std::endl << "{" << std::endl << std::endl;
+    out << "const std::uint8_t rom[] =" << std::endl << "{";
+    for (std::size_t i = 0; i < bytes.size(); i++)
+    {
+        out << (i % 16 == 0 ? "\n    " : " ") << format("0x%02X,", bytes[i]);
+    }
+    out << std::endl << "};" << std::endl << std::endl;
+    out << functions.str();
+    generator.table(out);
+    out << std::endl;
+    out << "const Chip8Aot::Program program = {\"" << name << "\", Chip8::Variant::" << (xo_chip ? "XO_CHIP" : "SUPER_CHIP") << ", "
+        << Generator::hex(analysis.get_load_address(), 3) << ", rom, sizeof rom, blocks, num_blocks};" << std::endl;
+    out << "Chip8Aot::Registration registration(program);" << std::endl << std::endl;
+    out << "}" << std::endl << std::endl;
+    out << "#endif /* CHIP8_AOT */" << std::endl;
+
+    std::cerr << "chip8_aot: " << name << ": " << generator.size() << " blocks compiled from " << analysis.get_blocks().size()
+        << ", " << analysis.get_indirect_jumps().size() << " indirect jumps left to the interpreter" << std::endl;
+    return 0;
+}
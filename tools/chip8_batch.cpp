@@ -0,0 +1,336 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "chip8.h"
+#include "chip8_batch.h"
+#include "movie.h"
+
+// Headless batch runner: executes many ROMs in parallel and reports one CSV line per ROM.
+
+struct Result
+{
+    std::uint64_t display_hash = 0;
+    std::string trap = "none";
+    std::uint64_t instructions = 0;
+};
+
+struct Job
+{
+    std::string path;
+    // results
+    bool loaded = false;
+    std::vector<Result> lanes; // one per lane with --lockstep, a single one otherwise
+    double wall_ms = 0;
+};
+
+struct Budget
+{
+    long long frames = 600; // emulated 60 Hz frames
+    long long cycles = 0; // stop after this many emulated cycles, which also pass while blocked, 0 for no limit
+    bool seeded = false;
+    std::uint64_t seed = 0; // ROM j is seeded with seed + j, so results do not depend on thread scheduling
+    bool xo_chip = false; // run every ROM as XO-CHIP, otherwise only those named *.xo8
+    const Movie* replay = nullptr; // play this movie back instead of running for a number of frames
+    int lockstep = 0; // run each ROM on this many lanes of a Chip8Batch, 0 to run it on a single Chip8
+    bool verify = false; // compare with the interpreter after every frame, or with lockstep every lane with a separate Chip8 after every cycle
+};
+
+std::uint64_t hash_display(const Chip8Planes& planes, bool hires, int num_planes)
+{
+    // FNV-1a over the packed words of the visible rows, the second word of each row only in high resolution,
+    // plane by plane so that classic programs keep the hashes of a single plane
+    std::uint64_t hash = 14695981039346656037ull;
+    int height = hires ? CHIP8_HIRES_HEIGHT : CHIP8_DISPLAY_HEIGHT;
+    int row_words = hires ? CHIP8_ROW_WORDS : 1;
+    for (int p = 0; p < num_planes; p++)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            for (int w = 0; w < row_words; w++)
+            {
+                std::uint64_t word = planes[p][y * CHIP8_ROW_WORDS + w];
+                for (int i = 0; i < 8; i++)
+                {
+                    hash ^= (word >> (8 * i)) & 0xFF;
+                    hash *= 1099511628211ull;
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+bool is_xo_chip(const std::string& path)
+{
+    return path.size() >= 4 && path.compare(path.size() - 4, 4, ".xo8") == 0;
+}
+
+bool same_state(const Chip8& a, const Chip8& b)
+{
+    // zeroed first so that padding compares equal
+    std::unique_ptr<Chip8::State> state_a(new Chip8::State());
+    std::unique_ptr<Chip8::State> state_b(new Chip8::State());
+    memset(state_a.get(), 0, sizeof(Chip8::State));
+    memset(state_b.get(), 0, sizeof(Chip8::State));
+    a.save_state(*state_a);
+    b.save_state(*state_b);
+    return memcmp(state_a.get(), state_b.get(), sizeof(Chip8::State)) == 0;
+}
+
+void run_job(Job& job, std::size_t index, const Budget& budget)
+{
+    std::ifstream file(job.path, std::ios::binary);
+    if (!file) return;
+    std::vector<std::uint8_t> bytes(std::istreambuf_iterator<char>(file), {});
+    job.loaded = true;
+
+    auto start = std::chrono::steady_clock::now();
+    // with --verify a second machine runs everything in the interpreter, to check the JIT or recompiled ROMs
+    std::unique_ptr<Chip8> chip8(new Chip8());
+    std::unique_ptr<Chip8> reference(budget.verify ? new Chip8() : nullptr);
+    if (reference) reference->use_interpreter();
+    for (Chip8* machine : {chip8.get(), reference.get()})
+    {
+        if (machine == nullptr) continue;
+        machine->set_trap_log(nullptr);
+        if (budget.xo_chip || is_xo_chip(job.path)) machine->set_variant(Chip8::Variant::XO_CHIP);
+        machine->seed(budget.seeded ? budget.seed + index : chip8->get_seed());
+        machine->load_program(bytes);
+    }
+    Movie::Result replay_result = Movie::Result::OK;
+    if (budget.replay != nullptr) replay_result = budget.replay->replay(*chip8, bytes);
+    if (budget.replay != nullptr && reference) budget.replay->replay(*reference, bytes);
+    bool mismatch = reference && budget.replay != nullptr && !same_state(*chip8, *reference);
+    // frame f ends at the instruction boundary of the (f + 1)-th timer tick
+    const long long clock_hz = chip8->get_clock_rate();
+    long long cycles_run = 0;
+    for (long long f = 0; budget.replay == nullptr && f < budget.frames; f++)
+    {
+        long long frame_end = ((f + 1) * clock_hz + 59) / 60;
+        if (budget.cycles > 0) frame_end = std::min(frame_end, budget.cycles);
+        chip8->run_cycles(frame_end - cycles_run);
+        if (reference) reference->run_cycles(frame_end - cycles_run);
+        cycles_run = frame_end;
+        if (reference && !same_state(*chip8, *reference))
+        {
+            mismatch = true;
+            std::cerr << "chip8_batch: " << job.path << ": differs from the interpreter after " << cycles_run << " cycles" << std::endl;
+            break;
+        }
+        if (chip8->is_interrupted()) break;
+        if (budget.cycles > 0 && cycles_run >= budget.cycles) break;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    int num_planes = chip8->get_variant() == Chip8::Variant::XO_CHIP ? CHIP8_PLANES : 1;
+    Result result;
+    result.display_hash = hash_display(chip8->get_planes(), chip8->is_hires(), num_planes);
+    if (chip8->is_interrupted()) result.trap = Chip8::exception_name(chip8->get_exception());
+    if (replay_result != Movie::Result::OK) result.trap = Movie::result_name(replay_result);
+    if (mismatch) result.trap = "CORE_MISMATCH";
+    result.instructions = chip8->get_instruction_count();
+    job.lanes.push_back(result);
+    job.wall_ms = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Runs the ROM on every lane of a Chip8Batch, lane k seeded with seed + index * lanes + k.
+void run_lockstep_job(Job& job, std::size_t index, const Budget& budget)
+{
+    std::ifstream file(job.path, std::ios::binary);
+    if (!file) return;
+    std::vector<std::uint8_t> bytes(std::istreambuf_iterator<char>(file), {});
+    job.loaded = true;
+
+    auto start = std::chrono::steady_clock::now();
+    int num_lanes = budget.lockstep;
+    Chip8::Variant variant = budget.xo_chip || is_xo_chip(job.path) ? Chip8::Variant::XO_CHIP : Chip8::Variant::SUPER_CHIP;
+    Chip8Batch batch(num_lanes);
+    batch.set_variant(variant);
+    // with --verify each lane has a separate Chip8 that must stay identical to it
+    std::vector<std::unique_ptr<Chip8>> references;
+    for (int lane = 0; lane < num_lanes; lane++)
+    {
+        if (budget.seeded) batch.seed(lane, budget.seed + index * num_lanes + lane);
+        if (!budget.verify) continue;
+        references.emplace_back(new Chip8());
+        references.back()->set_trap_log(nullptr);
+        references.back()->set_variant(variant);
+        references.back()->seed(batch.get_seed(lane));
+    }
+    batch.load_program(bytes);
+    for (auto& reference : references) reference->load_program(bytes);
+    job.lanes.resize(num_lanes);
+
+    std::unique_ptr<Chip8::State> expected(new Chip8::State());
+    std::unique_ptr<Chip8::State> actual(new Chip8::State());
+    int mismatched_lane = -1;
+    const long long clock_hz = batch.get_clock_rate();
+    long long cycles_run = 0;
+    for (long long f = 0; f < budget.frames && mismatched_lane < 0; f++)
+    {
+        long long frame_end = ((f + 1) * clock_hz + 59) / 60;
+        if (budget.cycles > 0) frame_end = std::min(frame_end, budget.cycles);
+        if (!budget.verify)
+        {
+            batch.run_cycles(frame_end - cycles_run);
+            cycles_run = frame_end;
+        }
+        for (; budget.verify && cycles_run < frame_end && mismatched_lane < 0; cycles_run++)
+        {
+            batch.run_cycles(1);
+            for (int lane = 0; lane < num_lanes; lane++)
+            {
+                references[lane]->run_cycles(1);
+                // zeroed first so that padding compares equal
+                memset(expected.get(), 0, sizeof(Chip8::State));
+                memset(actual.get(), 0, sizeof(Chip8::State));
+                references[lane]->save_state(*expected);
+                batch.save_state(lane, *actual);
+                if (memcmp(expected.get(), actual.get(), sizeof(Chip8::State)) != 0)
+                {
+                    mismatched_lane = lane;
+                    break;
+                }
+            }
+        }
+        bool all_interrupted = true;
+        for (int lane = 0; lane < num_lanes; lane++) all_interrupted = all_interrupted && batch.is_interrupted(lane);
+        if (all_interrupted) break;
+        if (budget.cycles > 0 && cycles_run >= budget.cycles) break;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    int num_planes = variant == Chip8::Variant::XO_CHIP ? CHIP8_PLANES : 1;
+    for (int lane = 0; lane < num_lanes; lane++)
+    {
+        Result& result = job.lanes[lane];
+        Chip8Planes planes;
+        for (int p = 0; p < CHIP8_PLANES; p++) planes[p] = batch.get_display(lane, p);
+        result.display_hash = hash_display(planes, batch.is_hires(lane), num_planes);
+        if (batch.is_interrupted(lane)) result.trap = Chip8::exception_name(batch.get_exception(lane));
+        if (lane == mismatched_lane) result.trap = "LOCKSTEP_MISMATCH";
+        result.instructions = batch.get_instruction_count(lane);
+    }
+    if (mismatched_lane >= 0)
+    {
+        std::cerr << "chip8_batch: " << job.path << ": lane " << mismatched_lane << " differs from Chip8 after " << cycles_run + 1 << " cycles" << std::endl;
+    }
+    job.wall_ms = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void usage()
+{
+    std::cerr << "usage: chip8_batch [--frames N] [--cycles N] [--threads N] [--seed N] [--xo-chip] [--replay MOVIE] [--lockstep N] [--verify] [--list FILE] [--out FILE] ROM..." << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    Budget budget;
+    unsigned int num_threads = std::thread::hardware_concurrency();
+    std::string out_path;
+    Movie movie;
+    std::vector<Job> jobs;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--frames" && has_value) budget.frames = std::atoll(argv[++i]);
+        else if (arg == "--cycles" && has_value) budget.cycles = std::atoll(argv[++i]);
+        else if (arg == "--seed" && has_value)
+        {
+            budget.seeded = true;
+            budget.seed = std::strtoull(argv[++i], nullptr, 0);
+        }
+        else if (arg == "--xo-chip") budget.xo_chip = true;
+        else if (arg == "--replay" && has_value)
+        {
+            std::ifstream file(argv[++i], std::ios::binary);
+            if (!movie.load(file))
+            {
+                std::cerr << "chip8_batch: cannot read movie " << argv[i] << std::endl;
+                return 1;
+            }
+            budget.replay = &movie;
+        }
+        else if (arg == "--lockstep" && has_value) budget.lockstep = std::atoi(argv[++i]);
+        else if (arg == "--verify") budget.verify = true;
+        else if (arg == "--threads" && has_value) num_threads = std::atoi(argv[++i]);
+        else if (arg == "--out" && has_value) out_path = argv[++i];
+        else if (arg == "--list" && has_value)
+        {
+            std::ifstream list(argv[++i]);
+            std::string line;
+            while (std::getline(list, line))
+            {
+                if (!line.empty()) jobs.push_back({line});
+            }
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else jobs.push_back({arg});
+    }
+    if (jobs.empty() || budget.lockstep < 0 || (budget.lockstep > 0 && budget.replay != nullptr))
+    {
+        usage();
+        return 1;
+    }
+    if (num_threads == 0) num_threads = 1;
+    num_threads = std::min<std::size_t>(num_threads, jobs.size());
+
+    // Workers pull the next job index until the list is exhausted.
+    std::atomic<std::size_t> next_job(0);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < num_threads; t++)
+    {
+        workers.emplace_back([&]()
+        {
+            for (std::size_t j = next_job++; j < jobs.size(); j = next_job++)
+            {
+                if (budget.lockstep > 0) run_lockstep_job(jobs[j], j, budget);
+                else run_job(jobs[j], j, budget);
+            }
+        });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    std::ofstream out_file;
+    if (!out_path.empty()) out_file.open(out_path);
+    std::ostream& out = out_path.empty() ? std::cout : out_file;
+    bool lockstep = budget.lockstep > 0;
+    out << (lockstep ? "rom,lane,display_hash,trap,instructions,wall_ms" : "rom,display_hash,trap,instructions,wall_ms") << std::endl;
+    int failed = 0;
+    for (auto& job : jobs)
+    {
+        if (!job.loaded)
+        {
+            out << job.path << (lockstep ? ",," : ",") << ",LOAD_FAILED,0,0" << std::endl;
+            failed++;
+            continue;
+        }
+        for (std::size_t lane = 0; lane < job.lanes.size(); lane++)
+        {
+            const Result& result = job.lanes[lane];
+            out << job.path << ",";
+            if (lockstep) out << lane << ",";
+            out << std::hex << std::setfill('0') << std::setw(16) << result.display_hash << std::dec << ","
+                << result.trap << ","
+                << result.instructions << ","
+                << std::fixed << std::setprecision(3) << job.wall_ms << std::endl;
+            if (result.trap == "LOCKSTEP_MISMATCH" || result.trap == "CORE_MISMATCH") failed++;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+#include "chip8.h"
+
+// Microbenchmarks for the core: ns per instruction for each opcode family, and whole-ROM throughput.
+
+// Names the build's cores for the CSV. Profiling builds run neither the JIT nor recompiled ROMs, and
+// AOT only covers ROMs compiled into the build, so the generated loops still run on the core named after it.
+static const char* core_name =
+#if defined(CHIP8_PROFILE) && defined(CHIP8_THREADED)
+    "threaded+profile";
+#elif defined(CHIP8_PROFILE)
+    "interpreter+profile";
+#elif defined(CHIP8_AOT) && defined(CHIP8_JIT)
+    "aot+jit";
+#elif defined(CHIP8_AOT) && defined(CHIP8_THREADED)
+    "aot+threaded";
+#elif defined(CHIP8_AOT)
+    "aot+interpreter";
+#elif defined(CHIP8_JIT)
+    "jit";
+#elif defined(CHIP8_THREADED)
+    "threaded";
+#else
+    "interpreter";
+#endif
+
+struct Bench
+{
+    std::string name;
+    std::vector<std::uint8_t> rom;
+    Chip8::Variant variant = Chip8::Variant::SUPER_CHIP;
+};
+
+struct Result
+{
+    std::string name;
+    std::uint64_t instructions = 0;
+    double ns_per_instruction = 0;
+    std::string trap = "none";
+};
+
+class RomBuilder
+{
+public:
+    // setup runs once, body is unrolled in a loop closed by a jump back to its start
+    RomBuilder& setup(std::initializer_list<std::uint16_t> instructions)
+    {
+        for (std::uint16_t ins : instructions) emit(ins);
+        return *this;
+    }
+    RomBuilder& loop(std::initializer_list<std::uint16_t> body, int unroll = 32)
+    {
+        std::uint16_t start = 0x200 + bytes.size();
+        for (int i = 0; i < unroll; i++)
+        {
+            for (std::uint16_t ins : body) emit(ins);
+        }
+        emit(0x1000 | start);
+        return *this;
+    }
+    // place instructions at a fixed address, used for subroutines
+    RomBuilder& at(std::uint16_t addr, std::initializer_list<std::uint16_t> instructions)
+    {
+        bytes.resize(std::max<std::size_t>(bytes.size(), addr - 0x200), 0);
+        for (std::uint16_t ins : instructions) emit(ins);
+        return *this;
+    }
+    std::vector<std::uint8_t> bytes;
+private:
+    void emit(std::uint16_t ins)
+    {
+        bytes.push_back(ins >> 8);
+        bytes.push_back(ins & 0xFF);
+    }
+};
+
+std::vector<Bench> opcode_benches()
+{
+    std::vector<Bench> benches;
+    benches.push_back({"load_add_6XNN_7XNN", RomBuilder().loop({0x6012, 0x7103, 0x6234, 0x7301}).bytes});
+    benches.push_back({"alu_8XYN", RomBuilder().setup({0x6035, 0x6107, 0x6280})
+        .loop({0x8010, 0x8121, 0x8202, 0x8013, 0x8124, 0x8205, 0x8016, 0x8127, 0x820E}).bytes});
+    // V0 = 0, V1 = 1 so none of the skips are taken
+    benches.push_back({"skip_not_taken", RomBuilder().setup({0x6101}).loop({0x3001, 0x4000, 0x5010, 0x9000}).bytes});
+    // every skip is taken and jumps over a filler instruction
+    benches.push_back({"skip_taken", RomBuilder().setup({0x6101})
+        .loop({0x3000, 0x7201, 0x4001, 0x7201, 0x5000, 0x7201, 0x9010, 0x7201}).bytes});
+    benches.push_back({"index_ANNN_FX1E", RomBuilder().setup({0x6003}).loop({0xA300, 0xF01E}).bytes});
+    benches.push_back({"timers_FX07_FX15_FX18", RomBuilder().setup({0x6000}).loop({0xF015, 0xF107, 0xF018}).bytes});
+    // DXYN at x = 0 (byte aligned), x = 3 (unaligned) and x = 60, y = 28 (clipped at the right and bottom edges)
+    for (int height : {1, 5, 15})
+    {
+        std::uint16_t draw = 0xD010 | height;
+        benches.push_back({"draw_D" + std::to_string(height) + "_aligned",
+            RomBuilder().setup({0xA050, 0x6000, 0x610A}).loop({draw}).bytes});
+        benches.push_back({"draw_D" + std::to_string(height) + "_unaligned",
+            RomBuilder().setup({0xA050, 0x6003, 0x610A}).loop({draw}).bytes});
+        benches.push_back({"draw_D" + std::to_string(height) + "_clipped",
+            RomBuilder().setup({0xA050, 0x603C, 0x611C}).loop({draw}).bytes});
+    }
+    benches.push_back({"clear_00E0", RomBuilder().loop({0x00E0}).bytes});
+    // SUPER-CHIP high resolution: a 16x16 sprite straddling the two words of each row, and scrolls
+    benches.push_back({"draw_D0_hires", RomBuilder().setup({0x00FF, 0xA050, 0x603C, 0x611C}).loop({0xD010}).bytes});
+    benches.push_back({"scroll_00CN_00FB_00FC", RomBuilder().setup({0x00FF}).loop({0x00C1, 0x00FB, 0x00FC}).bytes});
+    // XO-CHIP: a sprite drawn on both planes, a scroll of both planes, and the 4-byte long load
+    benches.push_back({"draw_D15_two_planes", RomBuilder().setup({0xF301, 0xA050, 0x6003, 0x610A}).loop({0xD01F}).bytes,
+        Chip8::Variant::XO_CHIP});
+    benches.push_back({"scroll_00DN_two_planes", RomBuilder().setup({0xF301, 0x00FF}).loop({0x00D1, 0x00C1}).bytes,
+        Chip8::Variant::XO_CHIP});
+    benches.push_back({"long_load_F000", RomBuilder().loop({0xF000, 0x1234}).bytes, Chip8::Variant::XO_CHIP});
+    benches.push_back({"bcd_FX33", RomBuilder().setup({0xA800, 0x60FF}).loop({0xF033}).bytes});
+    benches.push_back({"store_FX55", RomBuilder().setup({0xA800}).loop({0xFF55}).bytes});
+    benches.push_back({"load_FX65", RomBuilder().setup({0xA800}).loop({0xFF65}).bytes});
+    benches.push_back({"call_ret_2NNN_00EE", RomBuilder().loop({0x2400}).at(0x400, {0x00EE}).bytes});
+    benches.push_back({"jump_1NNN", RomBuilder().loop({0x1202}, 1).bytes});
+    return benches;
+}
+
+Result run(const std::string& name, std::vector<std::uint8_t>& rom, Chip8::Variant variant, std::uint64_t instructions, int repeat)
+{
+    Result result;
+    result.name = name;
+    double best_ns = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        std::unique_ptr<Chip8> chip8(new Chip8());
+        chip8->set_trap_log(nullptr);
+        chip8->set_variant(variant);
+        chip8->seed(0);
+        chip8->load_program(rom);
+        auto start = std::chrono::steady_clock::now();
+        chip8->run_cycles(instructions);
+        auto end = std::chrono::steady_clock::now();
+        std::uint64_t executed = chip8->get_instruction_count();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        if (r == 0 || ns < best_ns) best_ns = ns;
+        result.instructions = executed;
+        if (chip8->is_interrupted()) result.trap = Chip8::exception_name(chip8->get_exception());
+    }
+    result.ns_per_instruction = result.instructions > 0 ? best_ns / result.instructions : 0;
+    return result;
+}
+
+void usage()
+{
+    std::cerr << "usage: chip8_bench [--instructions N] [--repeat N] [--out FILE] [ROM...]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::uint64_t instructions = 20000000;
+    int repeat = 5;
+    std::string out_path;
+    std::vector<std::string> rom_paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--instructions" && has_value) instructions = std::strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--repeat" && has_value) repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--out" && has_value) out_path = argv[++i];
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else rom_paths.push_back(arg);
+    }
+
+    std::vector<Result> results;
+    for (Bench& bench : opcode_benches())
+    {
+        results.push_back(run(bench.name, bench.rom, bench.variant, instructions, repeat));
+    }
+    // whole ROMs run from power-on with no input
+    for (std::string& path : rom_paths)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cerr << "chip8_bench: cannot read " << path << std::endl;
+            return 1;
+        }
+        std::vector<std::uint8_t> bytes(std::istreambuf_iterator<char>(file), {});
+        Chip8::Variant variant = path.size() >= 4 && path.compare(path.size() - 4, 4, ".xo8") == 0
+            ? Chip8::Variant::XO_CHIP : Chip8::Variant::SUPER_CHIP;
+        results.push_back(run("rom:" + path, bytes, variant, instructions, repeat));
+    }
+
+    std::ofstream out_file;
+    if (!out_path.empty()) out_file.open(out_path);
+    std::ostream& out = out_path.empty() ? std::cout : out_file;
+    out << "core,benchmark,instructions,ns_per_instruction,mips,trap" << std::endl;
+    for (Result& result : results)
+    {
+        double mips = result.ns_per_instruction > 0 ? 1000.0 / result.ns_per_instruction : 0;
+        out << core_name << ","
+            << result.name << ","
+            << result.instructions << ","
+            << std::fixed << std::setprecision(3) << result.ns_per_instruction << ","
+            << std::setprecision(1) << mips << ","
+            << result.trap << std::endl;
+    }
+    return 0;
+}